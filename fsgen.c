@@ -2,112 +2,593 @@
 #include <unistd.h>
 #include <time.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
 
-#define HEADERS_MAX 64
-#define HEADER_MAGIC 0xBF
+//image format, must match src/kernel/util/vfs/initrd.h
+//initrd_header | entries[entry_count] | buckets[bucket_count] | names | file data
+#define INITRD_MAGIC	0x44525841 //"AXRD"
+#define INITRD_VERSION	3
+
+#define INITRD_ENTRY_FILE	0x1
+#define INITRD_ENTRY_DIR	0x2
+#define INITRD_ENTRY_COMPRESSED	0x4
+#define INITRD_BUCKET_EMPTY	0xFFFFFFFF
+
+//decoded size of each independently compressed block
+//small enough that the kernel's block cache stays small, big enough to compress well
+#define BLOCK_SIZE (16 * 1024)
+
+//LZ4 block format limits
+#define LZ4_MIN_MATCH 4
+//last match must start at least this far from the end of the block
+#define LZ4_MATCH_LIMIT 12
+//and the block always ends with at least this many literals
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 16
+
+//surface format, must match src/gfx/lib/surface.h
+//surface_header | surface_variant[variant_count] | pixel data
+#define SURFACE_MAGIC	0x46525553 //"SURF"
+#define SURFACE_VERSION	1
+#define SURFACE_SHADE_NORMAL	0
+#define SURFACE_SHADE_DARK	1
+//PIXEL_FORMAT_XRGB8888 in src/gfx/lib/pixel_format.h
+#define SURFACE_FORMAT_XRGB8888	0
+//rows and pixel data start on this boundary
+#define SURFACE_ALIGN 16
+
+//images in a directory with this name also get darkened and mip-mapped variants for rexle
+#define TEXTURE_DIR "textures"
+//must match REXLE_MIP_LEVELS in src/user/shell/programs/rexle/rexle.c
+#define TEXTURE_MIP_LEVELS 4
+//smallest mip level worth keeping
+#define TEXTURE_MIN_SIZE 8
+
+//kernel fs nodes hold names up to this long
+#define NAME_MAX_LEN 127
+//file data is aligned so the kernel can use it in place
+#define DATA_ALIGN 16
+
+typedef struct surface_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t variant_count;
+} surface_header;
+
+typedef struct surface_variant {
+	uint16_t level;
+	uint16_t shade;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	uint32_t offset;
+} surface_variant;
+
+//XRGB8888 image being converted
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t* pixels;
+} image;
 
 typedef struct initrd_header {
-	unsigned char magic;	//magic number
-	char name[64];
-	unsigned int offset;	//offset in initrd that the file starts
-	unsigned int length;	//length of file
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t bucket_count;
+	uint32_t entries_offset;
+	uint32_t buckets_offset;
+	uint32_t names_offset;
+	uint32_t length;
+	uint32_t block_size;
 } rd_header;
 
-FILE* openfile(const char* dirname, struct dirent* dir, const char* mode) {
-	char pathname[1024]; //should be big enough
-	FILE *fp;
+typedef struct initrd_entry {
+	uint32_t name_offset;
+	uint32_t hash;
+	uint32_t parent;
+	uint32_t flags;
+	uint32_t offset;
+	uint32_t length;
+} rd_entry;
+
+//entry being built, with the host path it came from
+typedef struct {
+	rd_entry entry;
+	char* name;
+	char* path;
+	//contents as they'll be stored in the image
+	unsigned char* data;
+	uint32_t stored_length;
+} node;
 
-	sprintf(pathname, "%s/%s", dirname, dir->d_name);
-	printf("trying to open file %s\n", pathname);
-	fp = fopen(pathname, mode);
-	return fp;
+static node* nodes;
+static uint32_t node_count;
+static uint32_t node_capacity;
+
+static uint32_t initrd_hash(uint32_t parent, const char* name) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 4; i++) {
+		hash = (hash ^ ((parent >> (i * 8)) & 0xFF)) * 16777619u;
+	}
+	while (*name) {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+	return hash;
 }
 
-void write_dir(const char* dirname) {
-	rd_header headers[HEADERS_MAX];
-	//initial file offset is size of initrd header * max headers + actual header count
-	unsigned int off = sizeof(rd_header) * HEADERS_MAX + sizeof(int);
-	
-	DIR* dp = opendir(dirname);
-	if (!dp) {
-		perror("Couldn't find directory");
+static int compress = 0;
+//which BMPs become surfaces
+//a surface is 4 bytes a pixel where most BMPs are 3, so converting everything trades a larger image for loads without decoding
+#define CONVERT_NONE		0
+#define CONVERT_TEXTURES	1 //only images in TEXTURE_DIR, which gain the most from their extra variants
+#define CONVERT_ALL		2
+static int convert_images = CONVERT_TEXTURES;
+
+static uint32_t read32(const unsigned char* p) {
+	uint32_t val;
+	memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+static unsigned char* lz4_write_length(unsigned char* op, uint32_t len) {
+	//length beyond what fit in the token nibble
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+static unsigned char* lz4_write_sequence(unsigned char* op, const unsigned char* literals, uint32_t literal_len, uint32_t offset, uint32_t match_len) {
+	unsigned char* token = op++;
+	*token = (literal_len >= 15 ? 15 : literal_len) << 4;
+	if (literal_len >= 15) op = lz4_write_length(op, literal_len - 15);
+	memcpy(op, literals, literal_len);
+	op += literal_len;
+
+	//final sequence is only literals
+	if (!match_len) return op;
+
+	*op++ = offset & 0xFF;
+	*op++ = offset >> 8;
+	match_len -= LZ4_MIN_MATCH;
+	*token |= match_len >= 15 ? 15 : match_len;
+	if (match_len >= 15) op = lz4_write_length(op, match_len - 15);
+	return op;
+}
+
+//greedy LZ4 block compressor
+//dest must hold at least len + len / 255 + 16 bytes
+static uint32_t lz4_compress(const unsigned char* src, uint32_t len, unsigned char* dest) {
+	static uint32_t table[1 << LZ4_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	unsigned char* op = dest;
+	uint32_t anchor = 0;
+	uint32_t ip = 0;
+	if (len > LZ4_MATCH_LIMIT) {
+		while (ip < len - LZ4_MATCH_LIMIT) {
+			uint32_t seq = read32(src + ip);
+			uint32_t h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+			//positions are stored plus one so 0 means empty
+			uint32_t ref = table[h];
+			table[h] = ip + 1;
+
+			if (!ref || ip - (ref - 1) > LZ4_MAX_OFFSET || read32(src + ref - 1) != seq) {
+				ip++;
+				continue;
+			}
+			ref--;
+
+			uint32_t match_len = LZ4_MIN_MATCH;
+			while (ip + match_len < len - LZ4_LAST_LITERALS && src[ref + match_len] == src[ip + match_len]) {
+				match_len++;
+			}
+
+			op = lz4_write_sequence(op, src + anchor, ip - anchor, ip - ref, match_len);
+			ip += match_len;
+			anchor = ip;
+		}
+	}
+	op = lz4_write_sequence(op, src + anchor, len - anchor, 0, 0);
+	return op - dest;
+}
+
+//split file into independently decodable blocks behind a table of their offsets
+static void compress_node(node* n) {
+	uint32_t len = n->entry.length;
+	uint32_t blocks = (len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	uint32_t table_len = (blocks + 1) * sizeof(uint32_t);
+
+	unsigned char* out = malloc(table_len + len + (len / 255) + (blocks * 16) + 16);
+	uint32_t* block_offsets = (uint32_t*)out;
+	uint32_t off = table_len;
+	for (uint32_t b = 0; b < blocks; b++) {
+		uint32_t block_len = (len - b * BLOCK_SIZE) < BLOCK_SIZE ? (len - b * BLOCK_SIZE) : BLOCK_SIZE;
+		const unsigned char* block = n->data + b * BLOCK_SIZE;
+
+		block_offsets[b] = off;
+		uint32_t stored = lz4_compress(block, block_len, out + off);
+		//incompressible blocks are stored as-is, which the kernel recognizes by their size
+		if (stored >= block_len) {
+			memcpy(out + off, block, block_len);
+			stored = block_len;
+		}
+		off += stored;
+	}
+	block_offsets[blocks] = off;
+
+	//not worth decoding if it barely shrank
+	if (off >= len - (len / 16)) {
+		free(out);
 		return;
 	}
 
-	int nheaders = 0;
-	struct dirent* ep;
-	while ((ep = readdir(dp))) {	
-		if (ep->d_type != DT_REG) {
-			printf("Found non-file (directory?) %s, skipping for now\n", ep->d_name);
-			continue;
+	free(n->data);
+	n->data = out;
+	n->stored_length = off;
+	n->entry.flags |= INITRD_ENTRY_COMPRESSED;
+}
+
+static uint32_t align_up(uint32_t val, uint32_t align) {
+	return (val + align - 1) & ~(align - 1);
+}
+
+//decode an uncompressed 24 or 32bpp BMP, the same ones the kernel's loader accepts
+static int parse_bmp(const unsigned char* data, uint32_t length, image* img) {
+	if (length < 54 || data[0] != 'B' || data[1] != 'M') return 0;
+
+	uint32_t pixel_offset = read32(data + 10);
+	int32_t width = (int32_t)read32(data + 18);
+	int32_t height = (int32_t)read32(data + 22);
+	uint16_t bpp = data[28] | (data[29] << 8);
+	uint32_t compression = read32(data + 30);
+
+	int top_down = height < 0;
+	if (top_down) height = -height;
+	if (width <= 0 || !height) return 0;
+	if (bpp != 24 && bpp != 32) return 0;
+	//BI_RGB, or BI_BITFIELDS with the channels where BI_RGB would put them
+	if (compression == 3) {
+		if (bpp != 32 || length < 54 + 12) return 0;
+		if (read32(data + 54) != 0xFF0000 || read32(data + 58) != 0xFF00 || read32(data + 62) != 0xFF) return 0;
+	}
+	else if (compression != 0) {
+		return 0;
+	}
+
+	uint32_t stride = ((width * bpp + 31) / 32) * 4;
+	if (pixel_offset + ((uint64_t)stride * height) > length) return 0;
+
+	img->width = width;
+	img->height = height;
+	img->pixels = malloc(width * height * sizeof(uint32_t));
+	for (int32_t y = 0; y < height; y++) {
+		//rows are stored bottom up unless the height was negative
+		const unsigned char* row = data + pixel_offset + (top_down ? y : height - 1 - y) * stride;
+		uint32_t* dest = img->pixels + y * width;
+		for (int32_t x = 0; x < width; x++) {
+			const unsigned char* px = row + x * (bpp / 8);
+			dest[x] = px[0] | (px[1] << 8) | (px[2] << 16);
 		}
-		
-		char pathname[1024];
-		sprintf(pathname, "%s/%s", dirname, ep->d_name);
-		printf("writing file %s at 0x%x\n", pathname, off);
+	}
+	return 1;
+}
+
+//every channel halved, as rexle shades walls facing north and south
+static image darken(const image* src) {
+	image dark = {src->width, src->height, malloc(src->width * src->height * sizeof(uint32_t))};
+	for (uint32_t i = 0; i < src->width * src->height; i++) {
+		dark.pixels[i] = (src->pixels[i] >> 1) & 0x7F7F7F;
+	}
+	return dark;
+}
 
-		strcpy(headers[nheaders].name, pathname);
-		//add null byte to end of filename
-		headers[nheaders].name[strlen(pathname)] = 0;
+//half size image, each pixel the rounded average of a 2x2 block of src
+static image downsample(const image* src) {
+	image half = {src->width / 2, src->height / 2, NULL};
+	half.pixels = malloc(half.width * half.height * sizeof(uint32_t));
+	for (uint32_t y = 0; y < half.height; y++) {
+		const uint32_t* row0 = src->pixels + (y * 2) * src->width;
+		const uint32_t* row1 = row0 + src->width;
+		for (uint32_t x = 0; x < half.width; x++) {
+			uint32_t px[4] = {row0[x * 2], row0[x * 2 + 1], row1[x * 2], row1[x * 2 + 1]};
+			uint32_t out = 0;
+			for (int shift = 0; shift < 24; shift += 8) {
+				uint32_t sum = 2;
+				for (int i = 0; i < 4; i++) sum += (px[i] >> shift) & 0xFF;
+				out |= (sum >> 2) << shift;
+			}
+			half.pixels[y * half.width + x] = out;
+		}
+	}
+	return half;
+}
 
-		//write offset into initrd
-		headers[nheaders].offset = off;
+//replace a BMP with a surface the kernel can use without decoding
+//textures also get a darkened copy of every mip level
+static void convert_node(node* n, int texture) {
+	image levels[TEXTURE_MIP_LEVELS];
+	if (!parse_bmp(n->data, n->entry.length, &levels[0])) return;
 
-		//open file so we can write binary data to initrd
-		//FILE* stream = openfile(dirname, ep, "rb");
-		FILE* stream = fopen(pathname, "rb");
-		if (!stream) {
-			printf("Error: file not found: %s\n", pathname);
-			exit(1);
+	uint32_t level_count = 1;
+	if (texture) {
+		while (level_count < TEXTURE_MIP_LEVELS &&
+			   levels[level_count - 1].width / 2 >= TEXTURE_MIN_SIZE &&
+			   levels[level_count - 1].height / 2 >= TEXTURE_MIN_SIZE) {
+			levels[level_count] = downsample(&levels[level_count - 1]);
+			level_count++;
 		}
-	
-		//find length of file 
-		fseek(stream, 0, SEEK_END);
-		headers[nheaders].length = ftell(stream);
-		printf("length is %d\n", headers[nheaders].length);
-		
-		fclose(stream);
+	}
 
-		off += headers[nheaders].length;
-		headers[nheaders].magic = HEADER_MAGIC;
+	//every level in normal shade, then dark if this is a texture
+	uint32_t shades = texture ? 2 : 1;
+	uint32_t variant_count = level_count * shades;
+	surface_variant* variants = calloc(variant_count, sizeof(surface_variant));
+	uint32_t off = align_up(sizeof(surface_header) + variant_count * sizeof(surface_variant), SURFACE_ALIGN);
+	for (uint32_t i = 0; i < variant_count; i++) {
+		const image* img = &levels[i / shades];
+		variants[i].level = i / shades;
+		variants[i].shade = (i % shades) ? SURFACE_SHADE_DARK : SURFACE_SHADE_NORMAL;
+		variants[i].width = img->width;
+		variants[i].height = img->height;
+		variants[i].pitch = align_up(img->width * sizeof(uint32_t), SURFACE_ALIGN);
+		variants[i].offset = off;
+		off += variants[i].pitch * img->height;
+	}
 
-		//prepare to write next file
-		nheaders++;	
+	unsigned char* out = calloc(1, off);
+	surface_header header = {SURFACE_MAGIC, SURFACE_VERSION, SURFACE_FORMAT_XRGB8888, variant_count};
+	memcpy(out, &header, sizeof(header));
+	memcpy(out + sizeof(header), variants, variant_count * sizeof(surface_variant));
+	for (uint32_t i = 0; i < variant_count; i++) {
+		image img = levels[i / shades];
+		if (variants[i].shade == SURFACE_SHADE_DARK) img = darken(&img);
+		for (uint32_t y = 0; y < img.height; y++) {
+			memcpy(out + variants[i].offset + y * variants[i].pitch, img.pixels + y * img.width, img.width * sizeof(uint32_t));
+		}
+		if (variants[i].shade == SURFACE_SHADE_DARK) free(img.pixels);
 	}
-	
-	FILE* wstream = fopen("./initrd.img", "w");
-	//write number of headers first
-	fwrite(&nheaders, sizeof(int), 1, wstream);
-	//write header info
-	fwrite(headers, sizeof(rd_header), HEADERS_MAX, wstream);
 
-	//write actual file data to initrd
-	printf("writing %d headers to initrd\n", nheaders);
-	for (int i = 0; i < nheaders; i++) {
-		FILE* stream = fopen(headers[i].name, "r");
-		if (!stream) {
-			printf("Couldn't find file %s!\n", headers[i].name);
+	printf("converted %s to a %dx%d surface with %d variants, %d bytes -> %d\n", n->path, levels[0].width, levels[0].height, variant_count, n->entry.length, off);
+	for (uint32_t i = 0; i < level_count; i++) {
+		free(levels[i].pixels);
+	}
+	free(variants);
+	free(n->data);
+	n->data = out;
+	n->entry.length = off;
+}
+
+static void load_node(node* n) {
+	FILE* stream = fopen(n->path, "rb");
+	if (!stream) {
+		printf("Error: file not found: %s\n", n->path);
+		exit(1);
+	}
+	n->data = (unsigned char*)malloc(n->entry.length ? n->entry.length : 1);
+	if (fread(n->data, 1, n->entry.length, stream) != n->entry.length) {
+		printf("Error: couldn't read %s\n", n->path);
+		exit(1);
+	}
+	fclose(stream);
+
+	int texture = !strcmp(nodes[n->entry.parent].name, TEXTURE_DIR);
+	if (convert_images == CONVERT_ALL || (convert_images == CONVERT_TEXTURES && texture)) {
+		convert_node(n, texture);
+	}
+	n->stored_length = n->entry.length;
+
+	if (compress && n->entry.length) {
+		compress_node(n);
+	}
+}
+
+static uint32_t add_node(const char* name, const char* path, uint32_t parent) {
+	if (strlen(name) > NAME_MAX_LEN) {
+		printf("Error: name too long: %s\n", path);
+		exit(1);
+	}
+	if (node_count == node_capacity) {
+		node_capacity = node_capacity ? node_capacity * 2 : 64;
+		nodes = realloc(nodes, node_capacity * sizeof(node));
+	}
+
+	node* n = &nodes[node_count];
+	memset(n, 0, sizeof(node));
+	n->name = strdup(name);
+	n->path = strdup(path);
+	n->entry.parent = parent;
+	n->entry.hash = initrd_hash(parent, name);
+	return node_count++;
+}
+
+static int compare_names(const void* a, const void* b) {
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+//append every child of directory idx as one contiguous run of entries
+static void add_children(uint32_t idx) {
+	DIR* dp = opendir(nodes[idx].path);
+	if (!dp) {
+		printf("Error: couldn't open directory %s: %s\n", nodes[idx].path, strerror(errno));
+		exit(1);
+	}
+
+	//sort names so images are reproducible
+	char** names = NULL;
+	uint32_t count = 0;
+	struct dirent* ep;
+	while ((ep = readdir(dp))) {
+		if (!strcmp(ep->d_name, ".") || !strcmp(ep->d_name, "..")) continue;
+		names = realloc(names, (count + 1) * sizeof(char*));
+		names[count++] = strdup(ep->d_name);
+	}
+	closedir(dp);
+	qsort(names, count, sizeof(char*), compare_names);
+
+	uint32_t first = node_count;
+	for (uint32_t i = 0; i < count; i++) {
+		char pathname[1024];
+		snprintf(pathname, sizeof(pathname), "%s/%s", nodes[idx].path, names[i]);
+
+		struct stat st;
+		if (stat(pathname, &st)) {
+			printf("Error: couldn't stat %s: %s\n", pathname, strerror(errno));
+			exit(1);
+		}
+		if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+			printf("Skipping %s, not a file or directory\n", pathname);
+			free(names[i]);
 			continue;
 		}
 
-		unsigned char* buf = (unsigned char*)malloc(headers[i].length);
-		fread(buf, 1, headers[i].length, stream);
-		fwrite(buf, 1, headers[i].length, wstream);
+		uint32_t child = add_node(names[i], pathname, idx);
+		if (S_ISDIR(st.st_mode)) {
+			nodes[child].entry.flags = INITRD_ENTRY_DIR;
+		}
+		else {
+			nodes[child].entry.flags = INITRD_ENTRY_FILE;
+			nodes[child].entry.length = st.st_size;
+		}
+		free(names[i]);
+	}
+	free(names);
 
-		fclose(stream);
-		free(buf);
+	//directory's offset and length index its children
+	nodes[idx].entry.offset = first;
+	nodes[idx].entry.length = node_count - first;
+}
+
+void write_dir(const char* dirname) {
+	node_count = 0;
+
+	//root is entry 0
+	//walking breadth first keeps every directory's children next to each other
+	add_node("", dirname, 0);
+	nodes[0].entry.flags = INITRD_ENTRY_DIR;
+	for (uint32_t i = 0; i < node_count; i++) {
+		if (nodes[i].entry.flags & INITRD_ENTRY_DIR) {
+			add_children(i);
+		}
+	}
+
+	//name index, at most half full so lookups stay short and always find an empty bucket
+	uint32_t bucket_count = 8;
+	while (bucket_count < node_count * 2) bucket_count *= 2;
+	uint32_t* buckets = malloc(bucket_count * sizeof(uint32_t));
+	memset(buckets, 0xFF, bucket_count * sizeof(uint32_t));
+	//root is never looked up by name
+	for (uint32_t i = 1; i < node_count; i++) {
+		uint32_t b = nodes[i].entry.hash & (bucket_count - 1);
+		while (buckets[b] != INITRD_BUCKET_EMPTY) {
+			b = (b + 1) & (bucket_count - 1);
+		}
+		buckets[b] = i;
+	}
+
+	//lay out tables, then file data
+	rd_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = INITRD_MAGIC;
+	header.version = INITRD_VERSION;
+	header.entry_count = node_count;
+	header.bucket_count = bucket_count;
+	header.entries_offset = sizeof(rd_header);
+	header.buckets_offset = header.entries_offset + node_count * sizeof(rd_entry);
+	header.names_offset = header.buckets_offset + bucket_count * sizeof(uint32_t);
+	header.block_size = BLOCK_SIZE;
+
+	uint32_t names_len = 0;
+	for (uint32_t i = 0; i < node_count; i++) {
+		nodes[i].entry.name_offset = names_len;
+		names_len += strlen(nodes[i].name) + 1;
+	}
+
+	uint32_t off = align_up(header.names_offset + names_len, DATA_ALIGN);
+	uint32_t total_length = 0;
+	uint32_t total_stored = 0;
+	for (uint32_t i = 0; i < node_count; i++) {
+		if (!(nodes[i].entry.flags & INITRD_ENTRY_FILE)) continue;
+		load_node(&nodes[i]);
+		nodes[i].entry.offset = off;
+		printf("writing file %s at 0x%x, length %d, stored in %d\n", nodes[i].path, off, nodes[i].entry.length, nodes[i].stored_length);
+		off = align_up(off + nodes[i].stored_length, DATA_ALIGN);
+		total_length += nodes[i].entry.length;
+		total_stored += nodes[i].stored_length;
+	}
+	header.length = off;
+
+	FILE* wstream = fopen("./initrd.img", "wb");
+	if (!wstream) {
+		perror("Couldn't create initrd.img");
+		exit(1);
+	}
+	fwrite(&header, sizeof(rd_header), 1, wstream);
+	for (uint32_t i = 0; i < node_count; i++) {
+		fwrite(&nodes[i].entry, sizeof(rd_entry), 1, wstream);
+	}
+	fwrite(buckets, sizeof(uint32_t), bucket_count, wstream);
+	for (uint32_t i = 0; i < node_count; i++) {
+		fwrite(nodes[i].name, 1, strlen(nodes[i].name) + 1, wstream);
 	}
 
+	//write actual file data to initrd
+	for (uint32_t i = 0; i < node_count; i++) {
+		if (!(nodes[i].entry.flags & INITRD_ENTRY_FILE)) continue;
+
+		//pad up to where the file was placed
+		while ((uint32_t)ftell(wstream) < nodes[i].entry.offset) {
+			fputc(0, wstream);
+		}
+		fwrite(nodes[i].data, 1, nodes[i].stored_length, wstream);
+		free(nodes[i].data);
+	}
+	while ((uint32_t)ftell(wstream) < header.length) {
+		fputc(0, wstream);
+	}
+
+	printf("wrote %d entries, %d buckets, %d bytes to initrd\n", node_count, bucket_count, header.length);
+	if (compress) {
+		printf("compressed %d bytes of files into %d (%d%%)\n", total_length, total_stored, total_length ? (int)(((uint64_t)total_stored * 100) / total_length) : 100);
+	}
 	fclose(wstream);
+
+	for (uint32_t i = 0; i < node_count; i++) {
+		free(nodes[i].name);
+		free(nodes[i].path);
+	}
+	free(buckets);
 }
 
+//usage: fsgen [-z] [-s | -r] dir
+//-z LZ4 compresses files which shrink enough to be worth decoding
+//by default only BMPs in textures directories are converted to surfaces
+//-s converts every BMP to a surface, the image grows by about a third of their size
+//-r stores every BMP as it is
 int main(int argc, char *argv[]) {
 	for (int arg = 1; arg < argc; arg++) {
+		if (!strcmp(argv[arg], "-z")) {
+			compress = 1;
+			continue;
+		}
+		if (!strcmp(argv[arg], "-s")) {
+			convert_images = CONVERT_ALL;
+			continue;
+		}
+		if (!strcmp(argv[arg], "-r")) {
+			convert_images = CONVERT_NONE;
+			continue;
+		}
 		write_dir(argv[arg]);
 	}
 	return EXIT_SUCCESS;
@@ -1,6 +1,7 @@
 #include <std/std.h>
 #include <gfx/lib/gfx.h>
 #include <gfx/lib/view.h>
+#include <std/math.h>
 #include "font8x8.h"
 
 #define CH_W 8
@@ -10,13 +11,22 @@ void draw_char(ca_layer* layer, char ch, int x, int y, Color color) {
 	Coordinate p = point_make(x, y);
 	if (p.x < 0 || p.y < 0 || p.x >= layer->size.width || p.y >= layer->size.height) return;
 
-	int* bitmap = font8x8_basic[(int)ch];
-	for (int i = 0; i < CH_H; i++) {
-		char row = bitmap[i];
-		for (int j = 0; j < CH_W; j++) {
-			if ((row >> j) & 1) {
-				putpixel(layer, p.x + j, p.y + i, color);
-			}
+	//clip glyph to layer once
+	int rows = MIN(CH_H, layer->size.height - p.y);
+	int cols = MIN(CH_W, layer->size.width - p.x);
+	uint8_t col_mask = (1 << cols) - 1;
+
+	uint32_t px = pixel_pack(color);
+	int pitch = layer_pitch(layer);
+	uint8_t* dest = layer_px(layer, p.x, p.y);
+
+	//the font only covers basic latin
+	const uint8_t* bitmap = font8x8_basic[ch & 0x7F];
+	for (int i = 0; i < rows; i++) {
+		uint8_t row = bitmap[i] & col_mask;
+		if (row) {
+			layer->ops->glyph_span(dest, row, px);
 		}
+		dest += pitch;
 	}
 }
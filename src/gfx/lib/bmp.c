@@ -1,7 +1,10 @@
 #include "bmp.h"
 #include <std/std.h>
 #include <kernel/util/vfs/fs.h>
+#include <kernel/drivers/rtc/clock.h>
+#include <std/math.h>
 #include "gfx.h"
+#include "surface.h"
 
 void bmp_teardown(Bmp* bmp) {
 	if (!bmp) return;
@@ -20,35 +23,132 @@ Bmp* create_bmp(Rect frame, ca_layer* layer) {
 	return bmp;
 }
 
+//BITMAPFILEHEADER followed by BITMAPINFOHEADER
+#define BMP_HEADER_SIZE 54
+#define BMP_BI_RGB 0
+#define BMP_BI_BITFIELDS 3
+
+typedef struct bmp_info {
+	uint32_t pixel_offset; //start of pixel data from start of file
+	int width;
+	int height;
+	bool top_down; //rows are stored bottom-up unless the header's height is negative
+	uint16_t bpp;
+	uint32_t stride; //rows are padded to a multiple of 4 bytes
+} bmp_info;
+
+static bool bmp_parse_header(const uint8_t* data, uint32_t length, bmp_info* info) {
+	if (length < BMP_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') {
+		return false;
+	}
+
+	info->pixel_offset = *(uint32_t*)&data[10];
+	info->width = *(int32_t*)&data[18];
+	info->height = *(int32_t*)&data[22];
+	info->bpp = *(uint16_t*)&data[28];
+	uint32_t compression = *(uint32_t*)&data[30];
+
+	info->top_down = info->height < 0;
+	info->height = abs(info->height);
+	info->stride = ((info->width * info->bpp + 31) / 32) * 4;
+
+	if (info->width <= 0 || !info->height) return false;
+
+	//only uncompressed 24 and 32bpp images
+	//32bpp bitfields are fine too as long as the channels are where BI_RGB would put them
+	if (compression == BMP_BI_BITFIELDS) {
+		if (info->bpp != 32 || length < BMP_HEADER_SIZE + 12) return false;
+		uint32_t* masks = (uint32_t*)&data[BMP_HEADER_SIZE];
+		if (masks[0] != 0xFF0000 || masks[1] != 0xFF00 || masks[2] != 0xFF) return false;
+	}
+	else if (compression != BMP_BI_RGB) {
+		return false;
+	}
+	if (info->bpp != 24 && info->bpp != 32) return false;
+
+	return info->pixel_offset + (info->stride * info->height) <= length;
+}
+
+//BGR triplets to XRGB8888
+static void bmp_convert_row_24(uint32_t* dest, const uint8_t* src, int width) {
+	for (int x = 0; x < width; x++, src += 3) {
+		dest[x] = src[0] | (src[1] << 8) | (src[2] << 16);
+	}
+}
+
+//BGRX is XRGB8888 in memory already
+static void bmp_convert_row_32(uint32_t* dest, const uint8_t* src, int width) {
+	memcpy(dest, src, width * sizeof(uint32_t));
+}
+
+//layer of pixels in bmp file data
+//if the pixels are already laid out like an XRGB8888 layer and data outlives the bmp, they're used in place
+static ca_layer* bmp_layer(const uint8_t* data, bmp_info* info, bool persistent, bool* wrapped) {
+	const uint8_t* pixels = data + info->pixel_offset;
+	Size size = size_make(info->width, info->height);
+
+	*wrapped = persistent && info->bpp == 32 && info->top_down && !((uint32_t)pixels & 3);
+	if (*wrapped) {
+		return create_layer_wrapping(size, PIXEL_FORMAT_XRGB8888, (uint8_t*)pixels);
+	}
+
+	ca_layer* layer = create_layer(size);
+	for (int y = 0; y < info->height; y++) {
+		//bottom-up images store the last row first
+		int src_row = info->top_down ? y : info->height - 1 - y;
+		const uint8_t* src = pixels + (src_row * info->stride);
+		if (info->bpp == 24) {
+			bmp_convert_row_24(layer_row(layer, y), src, info->width);
+		}
+		else {
+			bmp_convert_row_32(layer_row(layer, y), src, info->width);
+		}
+	}
+	return layer;
+}
+
 Bmp* load_bmp(Rect frame, char* filename) {
-	FILE* file = fopen(filename, (char*)"");
+	uint32_t start = time();
+
+	fs_node_t* file = lookup_fs(fs_root, filename);
 	if (!file) {
 		printf_err("File %s not found! Not loading BMP", filename);
 		return NULL;
 	}
 
-	unsigned char header[54];
-	fread(header, sizeof(char), 54, file);
+	//use the file's bytes in place if its filesystem has them in memory,
+	//otherwise read the whole thing in one go
+	bool copied;
+	uint8_t* data = load_fs(file, &copied);
+	if (!data) {
+		printf_err("Couldn't read %s", filename);
+		return NULL;
+	}
 
-	//get width and height from header
-	int width = *(int*)&header[18];
-	int height = *(int*)&header[22];
-	printf_info("loading BMP with dimensions (%d,%d)", width, height);
+	ca_layer* layer = NULL;
+	bool wrapped = false;
+	const char* kind = "surface";
+
+	//fsgen converts images into ready to use surfaces, anything else is decoded as a bmp
+	const surface_variant* variant = surface_find_variant(data, file->length, 0, SURFACE_SHADE_NORMAL);
+	bmp_info info;
+	if (variant) {
+		layer = surface_variant_layer(data, variant, !copied);
+		wrapped = layer->borrowed_raw;
+	}
+	else if (bmp_parse_header(data, file->length, &info)) {
+		layer = bmp_layer(data, &info, !copied, &wrapped);
+		kind = info.bpp == 24 ? "24bpp BMP" : "32bpp BMP";
+	}
+	else {
+		printf_err("%s isn't a surface or an uncompressed 24 or 32bpp BMP", filename);
+	}
 
-	int bpp = gfx_bpp();
-	ca_layer* layer = create_layer(size_make(width, height));
-	//image is upside down in memory so build array from bottom up
-	for (int i = width * height; i >= 0; i--) {
-		int idx = i * bpp;
-		//we process 3 bytes at a time because image is stored in BGR, we need RGB
-		layer->raw[idx + 0] = fgetc(file);
-		layer->raw[idx + 1] = fgetc(file);
-		layer->raw[idx + 2] = fgetc(file);
-		//fourth byte is for alpha channel if we used 32bit BMPs
-		//we only use 24bit, so don't try to read it
-		//fgetc(file);
+	if (copied) {
+		kfree(data);
 	}
+	if (!layer) return NULL;
 
-	Bmp* bmp = create_bmp(frame, layer);
-	return bmp;
+	printf_info("loaded %s (%dx%d %s) in %d ms%s", filename, layer->size.width, layer->size.height, kind, time() - start, wrapped ? ", pixels used in place" : "");
+	return create_bmp(frame, layer);
 }
@@ -3,19 +3,51 @@
 
 #include <std/std_base.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "rect.h"
+#include "pixel_format.h"
+#include "raster.h"
 
 __BEGIN_DECLS
 
 typedef struct ca_layer_t {
        	Size size;
        	uint8_t* raw;
-		float alpha;
+		float alpha; //opacity applied to the whole layer when it's blitted
+		pixel_format format; //XRGB8888, or premultiplied ARGB8888 for per-pixel alpha; converted to the framebuffer's format when presented
+		const raster_ops* ops; //span kernels for format
+		bool borrowed_raw; //raw belongs to someone else and isn't freed with the layer
 } ca_layer;
 
 struct ca_layer_t* create_layer(Size size);
+//like create_layer, but pixels are laid out in type
+//only 32bpp formats can be blended onto other layers
+struct ca_layer_t* create_layer_format(Size size, pixel_format_type type);
+//layer over existing pixels laid out in type, which must outlive the layer
+//raw is neither copied nor freed by layer_teardown
+struct ca_layer_t* create_layer_wrapping(Size size, pixel_format_type type, uint8_t* raw);
 void layer_teardown(ca_layer* layer);
 void blit_layer(ca_layer* dest, ca_layer* src, Coordinate origin);
+//like blit_layer, but only touches the part of dest within clip
+void blit_layer_clipped(ca_layer* dest, ca_layer* src, Coordinate origin, Rect clip);
+
+//first pixel of row y
+__attribute__((always_inline))
+inline uint32_t* layer_row(ca_layer* layer, int y) {
+	return (uint32_t*)layer->raw + (y * layer->size.width);
+}
+
+//address of pixel (x, y), for use with layer->ops
+__attribute__((always_inline))
+inline uint8_t* layer_px(ca_layer* layer, int x, int y) {
+	return layer->raw + (((y * layer->size.width) + x) * layer->format.bytes_per_pixel);
+}
+
+//bytes between the start of consecutive rows
+__attribute__((always_inline))
+inline int layer_pitch(ca_layer* layer) {
+	return layer->size.width * layer->format.bytes_per_pixel;
+}
 
 __END_DECLS
 
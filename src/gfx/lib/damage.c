@@ -0,0 +1,69 @@
+#include "damage.h"
+#include <std/std.h>
+#include <std/math.h>
+
+void damage_init(damage_region* region, Size bounds) {
+	memset(region, 0, sizeof(damage_region));
+	region->bounds = rect_make(point_zero(), bounds);
+}
+
+void damage_clear(damage_region* region) {
+	region->count = 0;
+}
+
+static uint32_t rect_area(Rect r) {
+	if (rect_is_empty(r)) return 0;
+	return r.size.width * r.size.height;
+}
+
+static void damage_remove(damage_region* region, int idx) {
+	region->rects[idx] = region->rects[--region->count];
+}
+
+void damage_add(damage_region* region, Rect r) {
+	r = rect_intersect(r, region->bounds);
+	if (rect_is_empty(r)) return;
+
+	//absorb every rect the new damage touches
+	//growing r can make it touch rects it previously missed, so rescan until nothing merges
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (int i = 0; i < region->count; i++) {
+			if (rect_intersects(region->rects[i], r)) {
+				r = rect_union(region->rects[i], r);
+				damage_remove(region, i);
+				merged = true;
+				break;
+			}
+		}
+	}
+
+	if (region->count < DAMAGE_MAX_RECTS) {
+		region->rects[region->count++] = r;
+		return;
+	}
+
+	//out of slots, fold r into whichever rect grows the least by absorbing it
+	int best = 0;
+	uint32_t best_growth = (uint32_t)-1;
+	for (int i = 0; i < region->count; i++) {
+		uint32_t growth = rect_area(rect_union(region->rects[i], r)) - rect_area(region->rects[i]);
+		if (growth < best_growth) {
+			best_growth = growth;
+			best = i;
+		}
+	}
+	Rect grown = rect_union(region->rects[best], r);
+	damage_remove(region, best);
+	//the grown rect may now overlap others
+	damage_add(region, grown);
+}
+
+uint32_t damage_pixels(damage_region* region) {
+	uint32_t total = 0;
+	for (int i = 0; i < region->count; i++) {
+		total += rect_area(region->rects[i]);
+	}
+	return total;
+}
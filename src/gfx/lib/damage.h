@@ -0,0 +1,29 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <std/std_base.h>
+#include <stdint.h>
+#include "rect.h"
+
+__BEGIN_DECLS
+
+//most rects tracked before new damage gets folded into an existing rect
+#define DAMAGE_MAX_RECTS 16
+
+//set of disjoint screen-space rects which must be recomposited and pushed to the framebuffer
+typedef struct damage_region {
+	Rect rects[DAMAGE_MAX_RECTS];
+	int count;
+	Rect bounds; //damage is clipped to this rect
+} damage_region;
+
+void damage_init(damage_region* region, Size bounds);
+//add r to region, merging it with any rects it touches
+void damage_add(damage_region* region, Rect r);
+void damage_clear(damage_region* region);
+//number of pixels covered by region
+uint32_t damage_pixels(damage_region* region);
+
+__END_DECLS
+
+#endif
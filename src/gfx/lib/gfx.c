@@ -54,8 +54,17 @@ Screen* screen_create(Size dimensions, uint32_t* physbase, uint8_t depth) {
 			screen->depth = depth;
 			//8 bits in a byte
 			screen->bpp = depth / 8;
+			screen->format = pixel_format_for_depth(depth);
+			screen->pitch = dimensions.width * screen->bpp;
+			//present by copying until the driver finds room for a second page
+			screen->page_count = 1;
+			screen->back_page = 0;
 			screen->vmem = create_layer(dimensions);
 
+			//nothing has been pushed to the framebuffer yet
+			damage_init(&screen->damage, dimensions);
+			damage_add(&screen->damage, rect_make(point_zero(), dimensions));
+
 			return screen;
 }
 
@@ -84,12 +93,52 @@ void vsync() {
 }
 
 void fill_screen(Screen* screen, Color color) {
-	memset(screen->vmem->raw, color.val[0], screen->window->size.width * screen->window->size.height * gfx_bpp());
+	//vmem rows are contiguous, so the whole layer is one span
+	ca_layer* vmem = screen->vmem;
+	vmem->ops->fill_span(vmem->raw, pixel_pack(color), vmem->size.width * vmem->size.height);
+}
+
+//convert the part of layer placed at origin which falls within clip into the framebuffer
+static void present_layer(Screen* screen, ca_layer* layer, Coordinate origin, Rect clip) {
+	Rect region = rect_intersect(rect_make(origin, layer->size), clip);
+	region = rect_intersect(region, rect_make(point_zero(), screen->vmem->size));
+	if (rect_is_empty(region)) return;
+
+	uint32_t* src = layer_row(layer, rect_min_y(region) - origin.y) + (rect_min_x(region) - origin.x);
+	//pages are stacked vertically in video memory
+	uint8_t* page = (uint8_t*)screen->physbase + (screen->back_page * screen->vmem->size.height * screen->pitch);
+	uint8_t* dest = page + (rect_min_y(region) * screen->pitch) + (rect_min_x(region) * screen->format.bytes_per_pixel);
+	for (int i = 0; i < region.size.height; i++) {
+		pixel_convert_span(screen->format, dest, src, region.size.width);
+		src += layer->size.width;
+		dest += screen->pitch;
+	}
 }
 
 void write_screen(Screen* screen) {
+	if (screen->page_count > 1) {
+		//the back page isn't visible, so write it whenever and flip at retrace
+		present_layer(screen, screen->vmem, point_zero(), rect_make(point_zero(), screen->vmem->size));
+		screen_flip(screen);
+		return;
+	}
 	vsync();
-	memcpy(screen->physbase, screen->vmem->raw, screen->vmem->size.width * screen->vmem->size.height * gfx_bpp());
+	present_layer(screen, screen->vmem, point_zero(), rect_make(point_zero(), screen->vmem->size));
+}
+
+void screen_flip(Screen* screen) {
+	if (screen->page_count < 2) return;
+
+	vesa_set_display_start(0, screen->back_page * screen->vmem->size.height);
+	screen->back_page ^= 1;
+}
+
+void write_screen_region(Screen* screen, Rect region) {
+	present_layer(screen, screen->vmem, point_zero(), region);
+}
+
+void write_screen_layer(Screen* screen, ca_layer* layer, Coordinate origin) {
+	present_layer(screen, layer, origin, rect_make(point_zero(), screen->vmem->size));
 }
 
 void rainbow_animation(Screen* screen, Rect r, int animationStep) {
@@ -6,6 +6,7 @@
 
 #include "rect.h"
 #include "view.h"
+#include "damage.h"
 #include <gfx/font/font.h>
 
 typedef struct __attribute__((packed)) {
@@ -15,13 +16,17 @@ typedef struct __attribute__((packed)) {
 
 typedef struct screen_t {
 	Window* window; //root window
-	uint16_t pitch; //redundant?
+	uint16_t pitch; //bytes per framebuffer row
 	uint16_t depth; //bits per pixel
 	uint8_t bpp; //bytes per pixel
+	pixel_format format; //layout of framebuffer, vmem is converted into it when presented
 	uint16_t pixelwidth; //redundant?
 	uint32_t* physbase; //address of beginning of framebuffer
+	uint8_t page_count; //2 if video memory holds a second page to flip to, otherwise 1 and frames are copied into the visible page
+	uint8_t back_page; //page presented into, made visible by screen_flip()
 	volatile int finished_drawing; //are we currently rendering a frame?
 	ca_layer* vmem; //raw framebuffer pushed to screen
+	damage_region damage; //regions of vmem which are out of date on the framebuffer
 } Screen;
 
 typedef struct Vec2d {
@@ -38,7 +43,17 @@ void gfx_teardown(Screen* screen);
 void vga_boot_screen(Screen* screen);
 
 void fill_screen(Screen* screen, Color color);
+//convert vmem into the framebuffer's pixel format and copy it to the screen
 void write_screen(Screen* screen);
+//copy only the part of vmem within region to the framebuffer
+void write_screen_region(Screen* screen, Rect region);
+//blit layer straight into the framebuffer at origin, bypassing vmem
+void write_screen_layer(Screen* screen, ca_layer* layer, Coordinate origin);
+//with two pages, show the back page and start presenting into the other one
+//waits for vertical retrace, so there's no need to vsync() first
+//does nothing when frames are copied into the visible page
+void screen_flip(Screen* screen);
+void vsync();
 
 void process_gfx_switch(int new_depth);
 int gfx_depth();
@@ -53,41 +68,18 @@ inline void putpixel(ca_layer* layer, int x, int y, Color color) {
 	//don't attempt writing a pixel outside of screen bounds
 	if (x < 0 || y < 0 || x >= layer->size.width || y >= layer->size.height) return;
 
-	int depth = gfx_depth();
-	if (depth == VGA_DEPTH) {
-		//VGA mode
-		uint16_t loc = ((y * layer->size.width * gfx_bpp()) + (x * gfx_bpp()));
-		layer->raw[loc] = color.val[0];
-	}
-	else {
-		//VESA mode
-		int offset = (x * gfx_bpp()) + (y * layer->size.width * gfx_bpp());
-		//we have to write the pixels in BGR, not RGB
-		layer->raw[offset + 0] = color.val[2];
-		layer->raw[offset + 1] = color.val[1];
-		layer->raw[offset + 2] = color.val[0];
-	}
+	layer_row(layer, y)[x] = pixel_pack(color);
 }
 __attribute__((always_inline))
 inline void addpixel(ca_layer* layer, int x, int y, Color color) {
 	//don't attempt writing a pixel outside of screen bounds
 	if (x < 0 || y < 0 || x >= layer->size.width || y >= layer->size.height) return;
 
-	int depth = gfx_depth();
-	if (depth == VGA_DEPTH) {
-		//VGA mode
-		uint16_t loc = ((y * layer->size.width) + x);
-		layer->raw[loc] += color.val[0];
-	}
-	else {
-		//VESA mode
-		int bpp = 24 / 8;
-		int offset = x * bpp + y * layer->size.width * bpp;
-		//we have to write the pixels in BGR, not RGB
-		layer->raw[offset + 0] += color.val[0];
-		layer->raw[offset + 1] += color.val[1];
-		layer->raw[offset + 2] += color.val[2];
-	}
+	//XRGB8888 is stored little endian, so the bytes are blue, green, red
+	uint8_t* px = (uint8_t*)&layer_row(layer, y)[x];
+	px[2] += color.val[0];
+	px[1] += color.val[1];
+	px[0] += color.val[2];
 }
 
 #endif
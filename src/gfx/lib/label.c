@@ -6,6 +6,7 @@ void label_teardown(Label* label) {
 
 	layer_teardown(label->layer);
 	kfree(label->text);
+	kfree(label->rendered_text);
 	kfree(label);
 }
 
@@ -16,7 +17,23 @@ Label* create_label(Rect frame, char* text) {
 	label->superview = NULL;
 	label->text_color = color_black();
 	label->needs_redraw = 1;
+	label->rendered_text = NULL;
 
 	label->text = strdup(text);
 	return label;
 }
+
+bool label_render_cached(Label* label, Color background) {
+	if (!label->rendered_text) return false;
+	return label->rendered_text_color == color_hex(label->text_color) &&
+		   label->rendered_background == color_hex(background) &&
+		   !strcmp(label->rendered_text, label->text);
+}
+
+void label_render_store(Label* label, Color background) {
+	//text is often a buffer its owner rewrites in place, so keep our own copy
+	kfree(label->rendered_text);
+	label->rendered_text = strdup(label->text);
+	label->rendered_text_color = color_hex(label->text_color);
+	label->rendered_background = color_hex(background);
+}
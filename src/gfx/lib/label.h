@@ -3,6 +3,7 @@
 
 #include <std/std_base.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "rect.h"
 #include "ca_layer.h"
 #include "color.h"
@@ -18,11 +19,21 @@ typedef struct label {
 
 	char* text;
 	Color text_color;
+
+	//what layer currently holds, so unchanged labels are blitted without rerendering
+	char* rendered_text;
+	uint32_t rendered_text_color;
+	uint32_t rendered_background;
 } Label;
 
 Label* create_label(Rect frame, char* text);
 void label_teardown(Label* label);
 
+//true if label's layer already holds its current text drawn over background
+bool label_render_cached(Label* label, Color background);
+//record that label's layer now holds its current text drawn over background
+void label_render_store(Label* label, Color background);
+
 __END_DECLS
 
 #endif
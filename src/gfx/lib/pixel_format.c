@@ -0,0 +1,86 @@
+#include "pixel_format.h"
+#include <std/std.h>
+
+pixel_format pixel_format_make(pixel_format_type type) {
+	pixel_format format;
+	format.type = type;
+	format.alpha_mask = 0;
+	switch (type) {
+		case PIXEL_FORMAT_XRGB8888:
+			format.bits_per_pixel = 32;
+			break;
+		case PIXEL_FORMAT_ARGB8888:
+			format.bits_per_pixel = 32;
+			format.alpha_mask = 0xFF000000;
+			break;
+		case PIXEL_FORMAT_BGR24:
+			format.bits_per_pixel = 24;
+			break;
+		case PIXEL_FORMAT_INDEXED8:
+		default:
+			format.bits_per_pixel = 8;
+			break;
+	}
+	format.bytes_per_pixel = format.bits_per_pixel / 8;
+	return format;
+}
+
+pixel_format pixel_format_for_depth(int depth) {
+	switch (depth) {
+		case 32:
+			return pixel_format_make(PIXEL_FORMAT_XRGB8888);
+		case 24:
+			return pixel_format_make(PIXEL_FORMAT_BGR24);
+		case 8:
+			return pixel_format_make(PIXEL_FORMAT_INDEXED8);
+		default:
+			ASSERT(0, "no pixel format for %d bpp", depth);
+	}
+	return pixel_format_make(PIXEL_FORMAT_XRGB8888);
+}
+
+static void convert_span_bgr24(uint8_t* dest, const uint32_t* src, int count) {
+	//pack every 4 source pixels into 3 whole words
+	uint32_t* dest_words = (uint32_t*)dest;
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		uint32_t p0 = src[i + 0];
+		uint32_t p1 = src[i + 1];
+		uint32_t p2 = src[i + 2];
+		uint32_t p3 = src[i + 3];
+		*dest_words++ = (p0 & 0xFFFFFF) | (p1 << 24);
+		*dest_words++ = ((p1 >> 8) & 0xFFFF) | (p2 << 16);
+		*dest_words++ = ((p2 >> 16) & 0xFF) | (p3 << 8);
+	}
+
+	//leftover pixels one byte at a time
+	dest = (uint8_t*)dest_words;
+	for (; i < count; i++) {
+		uint32_t px = src[i];
+		*dest++ = px & 0xFF;
+		*dest++ = (px >> 8) & 0xFF;
+		*dest++ = (px >> 16) & 0xFF;
+	}
+}
+
+void pixel_convert_span(pixel_format dest_format, uint8_t* dest, const uint32_t* src, int count) {
+	switch (dest_format.type) {
+		case PIXEL_FORMAT_XRGB8888:
+			memcpy(dest, src, count * sizeof(uint32_t));
+			break;
+		case PIXEL_FORMAT_ARGB8888:
+			//source pixels are opaque
+			for (int i = 0; i < count; i++) {
+				((uint32_t*)dest)[i] = src[i] | 0xFF000000;
+			}
+			break;
+		case PIXEL_FORMAT_BGR24:
+			convert_span_bgr24(dest, src, count);
+			break;
+		case PIXEL_FORMAT_INDEXED8:
+			for (int i = 0; i < count; i++) {
+				dest[i] = (src[i] >> 16) & 0xFF;
+			}
+			break;
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef PIXEL_FORMAT_H
+#define PIXEL_FORMAT_H
+
+#include <std/std_base.h>
+#include <stdint.h>
+#include "color.h"
+
+__BEGIN_DECLS
+
+typedef enum pixel_format_type {
+	PIXEL_FORMAT_XRGB8888 = 0, //0x00RRGGBB in an aligned 32-bit word, the default layer format
+	PIXEL_FORMAT_ARGB8888, //0xAARRGGBB with color premultiplied by alpha, for layers with per-pixel alpha
+	PIXEL_FORMAT_BGR24, //packed blue, green, red bytes, used by 24bpp VESA modes
+	PIXEL_FORMAT_INDEXED8, //VGA palette index, taken from the red channel
+} pixel_format_type;
+
+typedef struct pixel_format {
+	pixel_format_type type;
+	uint8_t bits_per_pixel;
+	uint8_t bytes_per_pixel;
+	uint32_t alpha_mask; //bits holding alpha, 0 if every pixel is opaque
+} pixel_format;
+
+pixel_format pixel_format_make(pixel_format_type type);
+//framebuffer format for a video mode with the given bits per pixel
+pixel_format pixel_format_for_depth(int depth);
+
+//convert count XRGB8888 pixels from src into dest, which is laid out in dest_format
+void pixel_convert_span(pixel_format dest_format, uint8_t* dest, const uint32_t* src, int count);
+
+//pack color into an XRGB8888 pixel
+__attribute__((always_inline))
+inline uint32_t pixel_pack(Color color) {
+	return (color.val[0] << 16) | (color.val[1] << 8) | color.val[2];
+}
+
+//pack color with coverage alpha (0-255) into a premultiplied ARGB8888 pixel
+__attribute__((always_inline))
+inline uint32_t pixel_pack_premultiplied(Color color, uint8_t alpha) {
+	uint32_t r = (color.val[0] * alpha + 127) / 255;
+	uint32_t g = (color.val[1] * alpha + 127) / 255;
+	uint32_t b = (color.val[2] * alpha + 127) / 255;
+	return ((uint32_t)alpha << 24) | (r << 16) | (g << 8) | b;
+}
+
+//unpack XRGB8888 pixel into a color
+__attribute__((always_inline))
+inline Color pixel_unpack(uint32_t px) {
+	Color color;
+	color.val[0] = (px >> 16) & 0xFF;
+	color.val[1] = (px >> 8) & 0xFF;
+	color.val[2] = px & 0xFF;
+	return color;
+}
+
+__END_DECLS
+
+#endif
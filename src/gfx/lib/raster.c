@@ -0,0 +1,180 @@
+#include "raster.h"
+#include <std/std.h>
+#include <kernel/util/fpu/fpu.h>
+//emmintrin.h pulls in mm_malloc.h, which needs the host's stdlib.h
+//we don't use _mm_malloc, so skip it
+#define _MM_MALLOC_H_INCLUDED
+#include <emmintrin.h>
+
+//exact x / 255, rounded, on two 16-bit lanes packed into one word
+//each lane must hold at most 255 * 255
+__attribute__((always_inline))
+static inline uint32_t div255_lanes(uint32_t x) {
+	x += 0x00800080;
+	return ((x + ((x >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+}
+
+//premultiplied src over dest, src is first scaled by opacity (0-256)
+__attribute__((always_inline))
+static inline uint32_t blend_px(uint32_t src, uint32_t dest, uint32_t opacity) {
+	//red/blue and alpha/green are 16 bits apart, so each pair is scaled in a single multiply
+	//without either product spilling into the other
+	uint32_t rb = (((src & 0x00FF00FF) * opacity) >> 8) & 0x00FF00FF;
+	uint32_t ag = ((((src >> 8) & 0x00FF00FF) * opacity) >> 8) & 0x00FF00FF;
+	uint32_t inv = 255 - (ag >> 16);
+
+	rb += div255_lanes((dest & 0x00FF00FF) * inv);
+	ag += div255_lanes(((dest >> 8) & 0x00FF00FF) * inv);
+	return rb | (ag << 8);
+}
+
+//every glyph row bit pattern expanded to whole-pixel masks, lowest bit is leftmost pixel
+//lets 32bpp formats write a glyph row as a run of masked words instead of testing each bit
+static uint32_t glyph_mask_lut[256][8];
+static bool glyph_mask_lut_ready = false;
+
+static void glyph_mask_lut_init() {
+	if (glyph_mask_lut_ready) return;
+	for (int row = 0; row < 256; row++) {
+		for (int bit = 0; bit < 8; bit++) {
+			glyph_mask_lut[row][bit] = (row & (1 << bit)) ? 0xFFFFFFFF : 0;
+		}
+	}
+	glyph_mask_lut_ready = true;
+}
+
+//generates the span kernels for one pixel format
+//LOAD reads an XRGB8888 value from a pixel, STORE writes an XRGB8888 value into a pixel
+//ALPHA is the format's alpha bits, pixels drawn in a solid color are made opaque
+#define RASTER_KERNELS(name, BPP, LOAD, STORE, ALPHA) \
+	static void name##_fill_span(uint8_t* dest, uint32_t px, int count) { \
+		px |= ALPHA; \
+		for (int i = 0; i < count; i++, dest += BPP) { \
+			STORE(dest, px); \
+		} \
+	} \
+	static void name##_copy_span(uint8_t* dest, const uint8_t* src, int count) { \
+		memcpy(dest, src, count * BPP); \
+	} \
+	static void name##_blend_span(uint8_t* dest, const uint32_t* src, int count, uint32_t opacity, uint32_t alpha_or) { \
+		for (int i = 0; i < count; i++, dest += BPP) { \
+			uint32_t px = blend_px(src[i] | alpha_or, LOAD(dest), opacity); \
+			STORE(dest, px & (0x00FFFFFF | ALPHA)); \
+		} \
+	} \
+	static void name##_glyph_span(uint8_t* dest, uint8_t mask, uint32_t px) { \
+		px |= ALPHA; \
+		if (BPP == 4 && mask) { \
+			/*whole-word pixels, write the row as masked words up to its last set bit*/ \
+			/*so a clipped row never touches pixels past the clip*/ \
+			const uint32_t* lut = glyph_mask_lut[mask]; \
+			uint32_t* out = (uint32_t*)dest; \
+			int count = 32 - __builtin_clz(mask); \
+			for (int i = 0; i < count; i++) { \
+				out[i] = (out[i] & ~lut[i]) | (px & lut[i]); \
+			} \
+			return; \
+		} \
+		for (; mask; mask >>= 1, dest += BPP) { \
+			if (mask & 1) STORE(dest, px); \
+		} \
+	} \
+	static const raster_ops name##_ops = { \
+		name##_fill_span, \
+		name##_copy_span, \
+		name##_blend_span, \
+		name##_glyph_span, \
+	};
+
+#define XRGB8888_LOAD(p)	(*(const uint32_t*)(p))
+#define XRGB8888_STORE(p, v)	(*(uint32_t*)(p) = (v))
+RASTER_KERNELS(xrgb8888, 4, XRGB8888_LOAD, XRGB8888_STORE, 0)
+RASTER_KERNELS(argb8888, 4, XRGB8888_LOAD, XRGB8888_STORE, 0xFF000000)
+
+#define BGR24_LOAD(p)		((p)[0] | ((p)[1] << 8) | ((p)[2] << 16))
+#define BGR24_STORE(p, v)	do { (p)[0] = (v); (p)[1] = (v) >> 8; (p)[2] = (v) >> 16; } while (0)
+RASTER_KERNELS(bgr24, 3, BGR24_LOAD, BGR24_STORE, 0)
+
+//palette index lives in the red channel
+#define INDEXED8_LOAD(p)	((uint32_t)(p)[0] << 16)
+#define INDEXED8_STORE(p, v)	((p)[0] = (v) >> 16)
+RASTER_KERNELS(indexed8, 1, INDEXED8_LOAD, INDEXED8_STORE, 0)
+
+//SSE2 version of blend_px on 4 pixels at once, each channel widened to a 16-bit lane
+//results are bit-identical to the scalar kernel
+__attribute__((target("sse2")))
+static inline __m128i blend_px_sse2(__m128i src, __m128i dest, __m128i opacity) {
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i c128 = _mm_set1_epi16(128);
+
+	src = _mm_srli_epi16(_mm_mullo_epi16(src, opacity), 8);
+	//broadcast each pixel's alpha lane across its 4 lanes
+	__m128i inv = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	inv = _mm_sub_epi16(c255, inv);
+
+	//dest * inv / 255, rounded
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(dest, inv), c128);
+	t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	return _mm_add_epi16(src, t);
+}
+
+//generates a 4-pixel-wide blend for a 32bpp format, with a scalar tail
+#define SSE2_BLEND_SPAN(name, ALPHA) \
+	__attribute__((target("sse2"))) \
+	static void name##_blend_span_sse2(uint8_t* dest, const uint32_t* src, int count, uint32_t opacity, uint32_t alpha_or) { \
+		const __m128i zero = _mm_setzero_si128(); \
+		const __m128i opacity_v = _mm_set1_epi16(opacity); \
+		const __m128i alpha_or_v = _mm_set1_epi32(alpha_or); \
+		const __m128i keep = _mm_set1_epi32(0x00FFFFFF | ALPHA); \
+		uint32_t* out = (uint32_t*)dest; \
+		int i = 0; \
+		for (; i + 4 <= count; i += 4) { \
+			__m128i s = _mm_or_si128(_mm_loadu_si128((const __m128i*)(src + i)), alpha_or_v); \
+			__m128i d = _mm_loadu_si128((const __m128i*)(out + i)); \
+			__m128i lo = blend_px_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), opacity_v); \
+			__m128i hi = blend_px_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), opacity_v); \
+			_mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(_mm_packus_epi16(lo, hi), keep)); \
+		} \
+		for (; i < count; i++) { \
+			out[i] = blend_px(src[i] | alpha_or, out[i], opacity) & (0x00FFFFFF | ALPHA); \
+		} \
+	} \
+	static const raster_ops name##_sse2_ops = { \
+		name##_fill_span, \
+		name##_copy_span, \
+		name##_blend_span_sse2, \
+		name##_glyph_span, \
+	};
+
+SSE2_BLEND_SPAN(xrgb8888, 0)
+SSE2_BLEND_SPAN(argb8888, 0xFF000000)
+
+const raster_ops* raster_ops_scalar(pixel_format format) {
+	glyph_mask_lut_init();
+	switch (format.type) {
+		case PIXEL_FORMAT_ARGB8888:
+			return &argb8888_ops;
+		case PIXEL_FORMAT_BGR24:
+			return &bgr24_ops;
+		case PIXEL_FORMAT_INDEXED8:
+			return &indexed8_ops;
+		case PIXEL_FORMAT_XRGB8888:
+		default:
+			return &xrgb8888_ops;
+	}
+}
+
+const raster_ops* raster_ops_for(pixel_format format) {
+	glyph_mask_lut_init();
+	if (fpu_sse2_enabled()) {
+		switch (format.type) {
+			case PIXEL_FORMAT_XRGB8888:
+				return &xrgb8888_sse2_ops;
+			case PIXEL_FORMAT_ARGB8888:
+				return &argb8888_sse2_ops;
+			default:
+				break;
+		}
+	}
+	return raster_ops_scalar(format);
+}
@@ -0,0 +1,35 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <std/std_base.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pixel_format.h"
+
+__BEGIN_DECLS
+
+//span kernels specialized for one pixel format
+//spans are always within bounds, callers clip once before running them
+//pixel values are passed as XRGB8888 and converted by the kernel
+typedef struct raster_ops {
+	//write px to count pixels starting at dest
+	void (*fill_span)(uint8_t* dest, uint32_t px, int count);
+	//copy count pixels from src to dest
+	void (*copy_span)(uint8_t* dest, const uint8_t* src, int count);
+	//composite count premultiplied ARGB8888 pixels from src over dest
+	//src is first scaled by opacity (0-256), alpha_or is ORed into each src pixel first,
+	//so XRGB8888 sources pass 0xFF000000 to be treated as opaque
+	void (*blend_span)(uint8_t* dest, const uint32_t* src, int count, uint32_t opacity, uint32_t alpha_or);
+	//write px to each of the 8 pixels starting at dest whose bit is set in mask
+	//lowest bit is leftmost pixel
+	void (*glyph_span)(uint8_t* dest, uint8_t mask, uint32_t px);
+} raster_ops;
+
+//fastest kernels this CPU supports for format
+const raster_ops* raster_ops_for(pixel_format format);
+//portable C kernels for format, used when SSE2 isn't available
+const raster_ops* raster_ops_scalar(pixel_format format);
+
+__END_DECLS
+
+#endif
@@ -2,6 +2,7 @@
 #include <std/kheap.h>
 #include <std/printf.h>
 #include <std/std.h>
+#include <std/math.h>
 
 static bool val_in_range(int value, int min, int max) { 
 	return (value >= min) && (value <= max); 
@@ -17,6 +18,58 @@ bool rect_intersects(Rect A, Rect B) {
     return x_overlap && y_overlap;
 }
 
+Rect rect_intersect(Rect A, Rect B) {
+	int min_x = MAX(rect_min_x(A), rect_min_x(B));
+	int min_y = MAX(rect_min_y(A), rect_min_y(B));
+	int max_x = MIN(rect_max_x(A), rect_max_x(B));
+	int max_y = MIN(rect_max_y(A), rect_max_y(B));
+
+	if (max_x <= min_x || max_y <= min_y) {
+		return rect_make(point_make(min_x, min_y), size_zero());
+	}
+	return rect_make(point_make(min_x, min_y), size_make(max_x - min_x, max_y - min_y));
+}
+
+Rect rect_union(Rect A, Rect B) {
+	if (rect_is_empty(A)) return B;
+	if (rect_is_empty(B)) return A;
+
+	int min_x = MIN(rect_min_x(A), rect_min_x(B));
+	int min_y = MIN(rect_min_y(A), rect_min_y(B));
+	int max_x = MAX(rect_max_x(A), rect_max_x(B));
+	int max_y = MAX(rect_max_y(A), rect_max_y(B));
+	return rect_make(point_make(min_x, min_y), size_make(max_x - min_x, max_y - min_y));
+}
+
+bool rect_is_empty(Rect r) {
+	return r.size.width <= 0 || r.size.height <= 0;
+}
+
+int rect_subtract(Rect subject, Rect cutting, Rect out[4]) {
+	Rect overlap = rect_intersect(subject, cutting);
+	if (rect_is_empty(overlap)) {
+		out[0] = subject;
+		return 1;
+	}
+
+	int count = 0;
+	//full-width bands above and below the overlap
+	if (rect_min_y(overlap) > rect_min_y(subject)) {
+		out[count++] = rect_make(subject.origin, size_make(subject.size.width, rect_min_y(overlap) - rect_min_y(subject)));
+	}
+	if (rect_max_y(overlap) < rect_max_y(subject)) {
+		out[count++] = rect_make(point_make(rect_min_x(subject), rect_max_y(overlap)), size_make(subject.size.width, rect_max_y(subject) - rect_max_y(overlap)));
+	}
+	//pieces to the left and right of the overlap, within its rows
+	if (rect_min_x(overlap) > rect_min_x(subject)) {
+		out[count++] = rect_make(point_make(rect_min_x(subject), rect_min_y(overlap)), size_make(rect_min_x(overlap) - rect_min_x(subject), overlap.size.height));
+	}
+	if (rect_max_x(overlap) < rect_max_x(subject)) {
+		out[count++] = rect_make(point_make(rect_max_x(overlap), rect_min_y(overlap)), size_make(rect_max_x(subject) - rect_max_x(overlap), overlap.size.height));
+	}
+	return count;
+}
+
 Rect rect_make(Coordinate origin, Size size) {
 	Rect rect;
 	rect.origin = origin;
@@ -20,6 +20,14 @@ Rect rect_make(Coordinate origin, Size size);
 Rect rect_zero();
 
 bool rect_intersects(Rect A, Rect B);
+//overlapping area of A and B, zero-sized if they don't overlap
+Rect rect_intersect(Rect A, Rect B);
+//smallest rect containing both A and B
+Rect rect_union(Rect A, Rect B);
+bool rect_is_empty(Rect r);
+//split the part of subject not covered by cutting into at most 4 disjoint rects, stored in out
+//returns the number of rects written
+int rect_subtract(Rect subject, Rect cutting, Rect out[4]);
 
 //explode subject rect into array of contiguous rects which are
 //not occluded by cutting rect
@@ -36,13 +36,12 @@ Shader* compute_shader(Shader* s) {
 void draw_shader(Screen* screen, Shader* s) {
 	Rect frame = absolute_frame(screen, s->superview);
 
-	int bpp = 24 / 8;
-	int offset = (frame.origin.x * bpp) + (frame.origin.y * screen->window->size.width * bpp);
-	uint8_t* shader_offset = (uint8_t*)s->raw;
-	for (int i = 0; i < frame.size.width; i++) {
-		memadd(screen->window->layer->raw + offset, shader_offset, frame.size.width * bpp);
-		offset += (screen->window->size.width * bpp);
-		shader_offset += frame.size.width * bpp;
+	//shader colors are packed RGB while layers hold XRGB8888, so add each pixel individually
+	for (int y = 0; y < frame.size.height; y++) {
+		for (int x = 0; x < frame.size.width; x++) {
+			int idx = (y * frame.size.width) + x;
+			addpixel(screen->window->layer, frame.origin.x + x, frame.origin.y + y, s->raw[idx]);
+		}
 	}
 }
 
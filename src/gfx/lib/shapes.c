@@ -56,41 +56,16 @@ void normalize_coordinate(ca_layer* layer, Coordinate* p) {
 //functions to draw shape structures
 static void draw_rect_int_fast(ca_layer* layer, Rect rect, Color color) {
 	//make sure we don't try to write to an invalid location
-	if (rect.origin.x < 0) {
-		rect.size.width += rect.origin.x;
-		rect.origin.x = 0;
-	}
-	if (rect.origin.y < 0) {
-		rect.size.height += rect.origin.y;
-		rect.origin.y = 0;
-	}
-	if (rect.origin.x + rect.size.width >= layer->size.width) {
-		rect.size.width -= (rect.origin.x + rect.size.width - layer->size.width);
-	}
-	if (rect.origin.y + rect.size.height >= layer->size.height) {
-		rect.size.height -= (rect.origin.y + rect.size.height - layer->size.height);
-	}
-
-	bool rgb = (gfx_depth() == VESA_DEPTH);
-	int bpp = (rgb ? 3 : 1);
-
-	int offset = rect.origin.x * bpp + rect.origin.y * layer->size.width * bpp;
-	int row_start = offset;
-	for (int y = rect.origin.y; y < rect.origin.y + rect.size.height; y++) {
-		for (int x = rect.origin.x; x < rect.origin.x + rect.size.width; x++) {
-			if (rgb) {
-				//we have to write the pixels in BGR, not RGB
-				layer->raw[offset++] = color.val[2];
-				layer->raw[offset++] = color.val[1];
-				layer->raw[offset++] = color.val[0];
-			}
-			else {
-				layer->raw[offset++] = color.val[0];
-			}
-		}
+	rect = rect_intersect(rect, rect_make(point_zero(), layer->size));
+	if (rect_is_empty(rect)) return;
+
+	uint32_t px = pixel_pack(color);
+	int pitch = layer_pitch(layer);
+	uint8_t* row_start = layer_px(layer, rect.origin.x, rect.origin.y);
+	for (int y = 0; y < rect.size.height; y++) {
+		layer->ops->fill_span(row_start, px, rect.size.width);
 		//move down 1 row
-		row_start += layer->size.width * bpp;
-		offset = row_start;
+		row_start += pitch;
 	}
 }
 
@@ -147,22 +122,10 @@ void draw_hline_fast(ca_layer* layer, Line line, Color color, int thickness) {
 	normalize_coordinate(layer, &line.p1);
 	normalize_coordinate(layer, &line.p2);
 
-	bool rgb = (gfx_depth() == VESA_DEPTH);
-	int bpp = (rgb ? 3 : 1);
+	if (line.p2.x <= line.p1.x || line.p1.y >= layer->size.height) return;
 
 	//calculate starting point
-	int offset = (line.p1.x * bpp) + (line.p1.y * bpp * layer->size.width);
-	for (int i = 0; i < line.p2.x - line.p1.x; i++) {
-		if (rgb) {
-			//we have to write the pixels in BGR, not RGB
-			layer->raw[offset++] = color.val[2];
-			layer->raw[offset++] = color.val[1];
-			layer->raw[offset++] = color.val[0];
-		}
-		else {
-			layer->raw[offset++] = color.val[0];
-		}
-	}
+	layer->ops->fill_span(layer_px(layer, line.p1.x, line.p1.y), pixel_pack(color), line.p2.x - line.p1.x);
 }
 
 void draw_vline_fast(ca_layer* layer, Line line, Color color, int thickness) {
@@ -170,26 +133,10 @@ void draw_vline_fast(ca_layer* layer, Line line, Color color, int thickness) {
 	normalize_coordinate(layer, &line.p1);
 	normalize_coordinate(layer, &line.p2);
 
-	bool rgb = (gfx_depth() == VESA_DEPTH);
-	int bpp = (rgb ? 3 : 1);
+	if (line.p2.y <= line.p1.y || line.p1.x >= layer->size.width) return;
 
-	//calculate starting point
-	int offset = (line.p1.x * bpp) + (line.p1.y * bpp * layer->size.width);
-	int row_start = offset;
-	for (int i = 0; i < line.p2.y - line.p1.y; i++) {
-		if (rgb) {
-			//we have to write the pixels in BGR, not RGB
-			layer->raw[offset++] = color.val[2];
-			layer->raw[offset++] = color.val[1];
-			layer->raw[offset] = color.val[0];
-		}
-		else {
-			layer->raw[offset] = color.val[0];
-		}
-		//go to next row
-		row_start += layer->size.width * bpp;
-		offset = row_start;
-	}
+	//a column is a stack of 1 pixel spans
+	draw_rect_int_fast(layer, rect_make(line.p1, size_make(1, line.p2.y - line.p1.y)), color);
 }
 #pragma GCC diagnostic pop
 
@@ -258,29 +205,57 @@ void draw_line(ca_layer* layer, Line line, Color color, int thickness) {
 	}
 }
 
+//fills the pixels of row y whose centers lie in [x1, x2), clipped to clip
+static inline void fill_row(ca_layer* layer, Rect clip, int y, int x1, int x2, uint32_t px) {
+	if (y < rect_min_y(clip) || y >= rect_max_y(clip)) return;
+	x1 = MAX(x1, rect_min_x(clip));
+	x2 = MIN(x2, rect_max_x(clip));
+	if (x2 <= x1) return;
+	layer->ops->fill_span(layer_px(layer, x1, y), px, x2 - x1);
+}
+
+//floor of n / d for d > 0, rounding toward negative infinity unlike C division
+static inline int floor_div(int n, int d) {
+	int q = n / d;
+	if ((n % d) && (n < 0)) q--;
+	return q;
+}
+
+//first pixel column whose center is at or right of where edge a->b crosses the center of row y
+//caller guarantees a.y < b.y
+static inline int edge_column(Coordinate a, Coordinate b, int y) {
+	//crossing is at a.x + (b.x - a.x) * (y + 0.5 - a.y) / (b.y - a.y)
+	//the first covered column is ceil(crossing - 0.5), all done in integers over 2 * dy
+	int dy = b.y - a.y;
+	int num = 2 * a.x * dy + (b.x - a.x) * (2 * (y - a.y) + 1) - dy;
+	return -floor_div(-num, 2 * dy);
+}
+
 void draw_triangle_int_fast(ca_layer* layer, Triangle triangle, Color color) {
-	//bounding rectangle
-	Coordinate min;
-	Coordinate max;
-	min.x = MIN(triangle.p1.x, triangle.p2.x);
-	min.x = MIN(min.x, triangle.p3.x);
-	min.y = MIN(triangle.p1.y, triangle.p2.y);
-	min.y = MIN(min.y, triangle.p3.y);
-	max.x = MAX(triangle.p1.x, triangle.p2.x);
-	max.x = MAX(min.x, triangle.p3.x);
-	max.y = MAX(triangle.p1.y, triangle.p2.y);
-	max.y = MAX(min.y, triangle.p3.y);
-
-	//scan bounding rectangle
-	for (int y = min.y; y < max.y; y++) {
-		for (int x = min.x; x < max.x; x++) {
-			//the pixel is bounded by the rectangle if all half-space functions are positive
-			if ((triangle.p1.x - triangle.p2.x) * (y - triangle.p1.y) - (triangle.p1.y - triangle.p2.y) * (x - triangle.p1.x) > 0 &&
-			    (triangle.p2.x - triangle.p3.x) * (y - triangle.p2.y) - (triangle.p2.y - triangle.p3.y) * (x - triangle.p2.x) > 0 &&
-			    (triangle.p3.x - triangle.p1.x) * (y - triangle.p3.y) - (triangle.p3.y - triangle.p1.y) * (x - triangle.p3.x) > 0) {
-				putpixel(layer, x, y, color);
-			}
-		}
+	//sort vertices from top to bottom
+	Coordinate top = triangle.p1;
+	Coordinate mid = triangle.p2;
+	Coordinate bot = triangle.p3;
+	Coordinate tmp;
+	if (mid.y < top.y) { tmp = top; top = mid; mid = tmp; }
+	if (bot.y < mid.y) { tmp = mid; mid = bot; bot = tmp; }
+	if (mid.y < top.y) { tmp = top; top = mid; mid = tmp; }
+
+	//degenerate triangle covers no pixel centers
+	if (bot.y == top.y) return;
+
+	//clip once, rows outside the layer are skipped entirely
+	Rect clip = rect_make(point_zero(), layer->size);
+	int y_start = MAX(top.y, rect_min_y(clip));
+	int y_end = MIN(bot.y, rect_max_y(clip));
+	uint32_t px = pixel_pack(color);
+
+	//walk the long edge top->bot against the two short edges top->mid and mid->bot
+	//a pixel is covered when its center is inside, so triangles sharing an edge never overlap or leave gaps
+	for (int y = y_start; y < y_end; y++) {
+		int long_x = edge_column(top, bot, y);
+		int short_x = (y < mid.y) ? edge_column(top, mid, y) : edge_column(mid, bot, y);
+		fill_row(layer, clip, y, MIN(long_x, short_x), MAX(long_x, short_x), px);
 	}
 }
 
@@ -338,56 +313,57 @@ void draw_triangle(ca_layer* layer, Triangle tri, Color color, int thickness) {
 	draw_triangle_int(layer, tri, color);
 }
 
-void draw_circle_int(ca_layer* layer, Circle circle, Color color) {
-	int x = 0;
-	int y = circle.radius;
-	int dp = 1 - circle.radius;
-	do {
-		if (dp < 0) {
-			dp = dp + 2 * (++x) + 3;
-		}
-		else {
-			dp = dp + 2 * (++x) - 2 * (--y) + 5;
-		}
-
-		putpixel(layer, circle.center.x + x, circle.center.y + y, color);
-		putpixel(layer, circle.center.x - x, circle.center.y + y, color);
-		putpixel(layer, circle.center.x + x, circle.center.y - y, color);
-		putpixel(layer, circle.center.x - x, circle.center.y - y, color);
-		putpixel(layer, circle.center.x + y, circle.center.y + x, color);
-		putpixel(layer, circle.center.x - y, circle.center.y + x, color);
-		putpixel(layer, circle.center.x + y, circle.center.y - x, color);
-		putpixel(layer, circle.center.x - y, circle.center.y - x, color);
-	} while (x < y);
-
-	//put pixels at intersections of quadrants
-	putpixel(layer, circle.center.x, circle.center.y - circle.radius, color);
-	putpixel(layer, circle.center.x + circle.radius, circle.center.y, color);
-	putpixel(layer, circle.center.x, circle.center.y + circle.radius, color);
-	putpixel(layer, circle.center.x - circle.radius, circle.center.y, color);
+//widest half-span w such that w^2 + dy^2 <= r^2 + r
+//stepping dy towards 0 only ever grows w, so a caller walking rows outward-in advances it incrementally
+static inline int circle_half_width(int radius, int dy, int w) {
+	int limit = radius * radius + radius - dy * dy;
+	while ((w + 1) * (w + 1) <= limit) w++;
+	return w;
 }
 
 void draw_circle(ca_layer* layer, Circle circ, Color color, int thickness) {
-	if (circ.center.x + circ.radius > layer->size.width) {
-		circ.radius = layer->size.width - circ.center.x;
-	}
-	if (circ.center.y + circ.radius > layer->size.height) {
-		circ.radius = layer->size.height - circ.center.y;
-	}
+	int radius = circ.radius;
+	if (radius < 0) return;
 
-	int max_thickness = circ.radius;
 	//if the thickness indicates the shape should be filled, set it as such
-	if (thickness < 0) thickness = max_thickness;
-
+	if (thickness < 0) thickness = radius;
 	//make sure they don't set one too big
-	thickness = MIN(thickness, max_thickness);
+	thickness = MIN(thickness, radius);
 
-	Circle c = circle_make(circ.center, circ.radius);
+	//ring covers radii [radius - thickness, radius], so anything inside inner_radius is left untouched
+	int inner_radius = radius - thickness - 1;
 
-	for (int i = 0; i <= thickness; i++) {
-		draw_circle_int(layer, c, color);
+	//clip once against the layer
+	Rect clip = rect_make(point_zero(), layer->size);
+	Rect bounds = rect_make(point_make(circ.center.x - radius, circ.center.y - radius), size_make(radius * 2 + 1, radius * 2 + 1));
+	if (rect_is_empty(rect_intersect(bounds, clip))) return;
+
+	uint32_t px = pixel_pack(color);
+	int cx = circ.center.x;
+	int cy = circ.center.y;
+
+	//walk rows from the poles to the equator, emitting the mirrored rows above and below the center together
+	int outer_w = 0;
+	int inner_w = 0;
+	for (int dy = radius; dy >= 0; dy--) {
+		outer_w = circle_half_width(radius, dy, outer_w);
 
-		//decrease radius for next shell
-		c.radius -= 1;
+		int rows[2] = {cy - dy, cy + dy};
+		int row_count = dy ? 2 : 1;
+
+		if (dy > inner_radius) {
+			//row passes above or below the hole, one span covers it
+			for (int i = 0; i < row_count; i++) {
+				fill_row(layer, clip, rows[i], cx - outer_w, cx + outer_w + 1, px);
+			}
+			continue;
+		}
+
+		//row crosses the hole, fill either side of it
+		inner_w = circle_half_width(inner_radius, dy, inner_w);
+		for (int i = 0; i < row_count; i++) {
+			fill_row(layer, clip, rows[i], cx - outer_w, cx - inner_w, px);
+			fill_row(layer, clip, rows[i], cx + inner_w + 1, cx + outer_w + 1, px);
+		}
 	}
 }
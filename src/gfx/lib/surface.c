@@ -0,0 +1,40 @@
+#include "surface.h"
+#include <std/std.h>
+
+const surface_variant* surface_find_variant(const uint8_t* data, uint32_t length, int level, int shade) {
+	if (length < sizeof(surface_header)) return NULL;
+
+	const surface_header* header = (const surface_header*)data;
+	if (header->magic != SURFACE_MAGIC || header->version != SURFACE_VERSION) return NULL;
+	//only formats layers can be built from
+	if (header->format != PIXEL_FORMAT_XRGB8888 && header->format != PIXEL_FORMAT_ARGB8888) return NULL;
+	if (sizeof(surface_header) + (header->variant_count * sizeof(surface_variant)) > length) return NULL;
+
+	const surface_variant* variants = (const surface_variant*)(header + 1);
+	for (uint32_t i = 0; i < header->variant_count; i++) {
+		const surface_variant* variant = &variants[i];
+		if (variant->level != level || variant->shade != shade) continue;
+
+		//make sure a truncated file can't send us past its end
+		if (variant->pitch < variant->width * sizeof(uint32_t)) return NULL;
+		if (variant->offset + (variant->pitch * variant->height) > length) return NULL;
+		return variant;
+	}
+	return NULL;
+}
+
+ca_layer* surface_variant_layer(const uint8_t* data, const surface_variant* variant, bool persistent) {
+	pixel_format_type format = ((const surface_header*)data)->format;
+	Size size = size_make(variant->width, variant->height);
+
+	//layers don't have a pitch of their own, so padded rows have to be packed
+	if (persistent && variant->pitch == variant->width * sizeof(uint32_t)) {
+		return create_layer_wrapping(size, format, (uint8_t*)data + variant->offset);
+	}
+
+	ca_layer* layer = create_layer_format(size, format);
+	for (uint32_t y = 0; y < variant->height; y++) {
+		memcpy(layer_row(layer, y), surface_row(data, variant, y), variant->width * sizeof(uint32_t));
+	}
+	return layer;
+}
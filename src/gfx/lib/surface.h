@@ -0,0 +1,52 @@
+#ifndef SURFACE_H
+#define SURFACE_H
+
+#include <std/std_base.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ca_layer.h"
+
+__BEGIN_DECLS
+
+//images fsgen pre-converted into a layer pixel format, so they can be used without decoding
+//fsgen keeps its own copy of these definitions
+//file layout: surface_header | surface_variant[variant_count] | pixel data
+//offsets are from the start of the file, and every variant's rows are 16 byte aligned
+#define SURFACE_MAGIC	0x46525553 //"SURF"
+#define SURFACE_VERSION	1
+
+#define SURFACE_SHADE_NORMAL	0
+#define SURFACE_SHADE_DARK	1 //every channel halved
+
+typedef struct surface_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format; //pixel_format_type of every variant
+	uint32_t variant_count;
+} surface_header;
+
+typedef struct surface_variant {
+	uint16_t level; //mip level, each level is half the size of the one before
+	uint16_t shade;
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch; //bytes between the start of consecutive rows
+	uint32_t offset; //first row
+} surface_variant;
+
+//returns the variant of surface file data at mip level and shade,
+//or NULL if data isn't a surface or doesn't have that variant
+const surface_variant* surface_find_variant(const uint8_t* data, uint32_t length, int level, int shade);
+
+//layer holding variant's pixels
+//if data stays in memory for good and the rows are packed, the layer uses them in place
+ca_layer* surface_variant_layer(const uint8_t* data, const surface_variant* variant, bool persistent);
+
+//first pixel of row y of variant
+static inline const uint32_t* surface_row(const uint8_t* data, const surface_variant* variant, int y) {
+	return (const uint32_t*)(data + variant->offset + (y * variant->pitch));
+}
+
+__END_DECLS
+
+#endif
@@ -48,6 +48,9 @@ View* create_view(Rect frame) {
 	view->layer = create_layer(frame.size);
 	view->frame = frame;
 	view->superview = NULL;
+	view->window = NULL;
+	view->window_frame = frame;
+	view->dirty = rect_zero();
 	view->background_color = color_make(0, 255, 0);
 	view->subviews = array_m_create(MAX_ELEMENTS);
 	view->labels = array_m_create(MAX_ELEMENTS);
@@ -57,15 +60,67 @@ View* create_view(Rect frame) {
 	return view;
 }
 
+static damage_handler damage_callback = NULL;
+
+void set_damage_handler(damage_handler handler) {
+	damage_callback = handler;
+}
+
+static void report_damage(View* view, Rect frame) {
+	if (damage_callback) {
+		damage_callback(view, frame);
+	}
+}
+
+//windows are passed around as views, a Window's window field points back at itself
+static bool is_window(View* view) {
+	return view->window == (struct window*)view;
+}
+
 void mark_needs_redraw(View* view) {
 	if (!view) return;
 
-	//if this view has already been marked, quit
-	if (view->needs_redraw) return;
-
+	//superviews contain this view's frame, so only report damage for this view
+	report_damage(view, view->frame);
+	//superviews keep their rendered content, they recomposite this view once it's re-rendered
 	view->needs_redraw = 1;
-	if (view->superview && view->superview->superview) {
-		mark_needs_redraw(view->superview);
+}
+
+void view_invalidate(View* view, Rect rect) {
+	if (!view) return;
+
+	rect = rect_intersect(rect, rect_make(point_zero(), view->frame.size));
+	view->dirty = rect_union(view->dirty, rect);
+}
+
+//whatever holds a composited copy of view must recomposite frame,
+//in the coordinate space of view's superview
+static void invalidate_superview(View* view, Rect frame) {
+	//windows are composited straight from damage
+	if (is_window(view)) return;
+
+	if (view->superview) {
+		view_invalidate(view->superview, frame);
+	}
+	else if (view->window) {
+		//top-level views are composited by their window
+		view->window->needs_redraw = 1;
+	}
+}
+
+void view_set_window(View* view, struct window* window) {
+	if (!view || is_window(view)) return;
+
+	view->window = window;
+	view->window_frame = view->frame;
+	if (view->superview) {
+		view->window_frame.origin.x += view->superview->window_frame.origin.x;
+		view->window_frame.origin.y += view->superview->window_frame.origin.y;
+	}
+
+	for (int i = 0; i < view->subviews->size; i++) {
+		View* subview = (View*)array_m_lookup(view->subviews, i);
+		view_set_window(subview, window);
 	}
 }
 
@@ -92,16 +147,22 @@ void add_subview(View* view, View* subview) {
 
 	array_m_insert(view->subviews, subview);
 	subview->superview = view;
-	mark_needs_redraw(view);
+	view_set_window(subview, view->window);
+
+	view_invalidate(view, subview->frame);
+	report_damage(subview, subview->frame);
 }
 
 void remove_subview(View* view, View* subview) {
 	if (!view || !subview) return;
 
+	//uncover whatever subview was covering while it can still be located
+	view_invalidate(view, subview->frame);
+	report_damage(subview, subview->frame);
+
 	array_m_remove(view->subviews, array_m_index(view->subviews, subview));
 	subview->superview = NULL;
-	subview->needs_redraw = 1;
-	mark_needs_redraw(view);
+	view_set_window(subview, NULL);
 }
 
 void add_bmp(View* view, Bmp* bmp) {
@@ -158,6 +219,14 @@ void set_frame(View* view, Rect frame) {
 	if (old_frame.size.width != frame.size.width || old_frame.size.height != frame.size.height) {
 		mark_needs_redraw(view);
 	}
+	//subviews moved along with view
+	view_set_window(view, view->window);
+
+	//uncover whatever was beneath the old frame, and composite the view at its new position
+	invalidate_superview(view, old_frame);
+	invalidate_superview(view, frame);
+	report_damage(view, old_frame);
+	report_damage(view, frame);
 }
 
 void set_alpha(View* view, float alpha) {
@@ -167,4 +236,6 @@ void set_alpha(View* view, float alpha) {
 	alpha = MAX(MIN(alpha, 1), 0);
 
 	view->layer->alpha = alpha;
+	invalidate_superview(view, view->frame);
+	report_damage(view, view->frame);
 }
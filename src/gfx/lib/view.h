@@ -19,6 +19,16 @@ typedef struct view {
 	ca_layer* layer;
 	struct view *superview;
 	array_m* subviews;
+	//window this view is displayed in, NULL until it's attached to one
+	//shares its offset with Window's own field, which points back at the window itself
+	struct window* window;
+
+	//frame in the coordinate space of window, kept up to date as frames change
+	//so absolute positions never need a walk up the hierarchy
+	Rect window_frame;
+	//part of layer whose subviews must be recomposited, in view's coordinates
+	//needs_redraw means view's own content changed and the whole layer must be re-rendered
+	Rect dirty;
 	
 	Color background_color;
 	array_m* labels;
@@ -43,6 +53,14 @@ void add_bmp(View* view, Bmp* bmp);
 void remove_bmp(View* view, Bmp* bmp);
 
 void mark_needs_redraw(View* view);
+//mark rect of view's layer as needing its cached subview layers recomposited
+void view_invalidate(View* view, Rect rect);
+//attach view and its subviews to window, as a top-level view of the window when superview is NULL
+void view_set_window(View* view, struct window* window);
+
+//receives every rect which needs to be recomposited, in the coordinate space of view's superview
+typedef void (*damage_handler)(View* view, Rect frame);
+void set_damage_handler(damage_handler handler);
 	
 __END_DECLS
 
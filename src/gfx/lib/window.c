@@ -52,12 +52,15 @@ Window* create_window_int(Rect frame, bool root) {
 	window->border_width = 1;
 	window->subviews = array_m_create(MAX_ELEMENTS);
 	window->title = "Window";
+	window->window = window;
 
 	//root window doesn't have a title view
 	if (!root) {
 		window->title_view = create_title_view(window);
+		view_set_window(window->title_view, window);
 	}
 	window->content_view = create_content_view(window, root);
+	view_set_window(window->content_view, window);
 
 	window->needs_redraw = 1;
 
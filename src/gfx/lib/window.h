@@ -17,6 +17,7 @@ typedef struct window {
 	ca_layer* layer;
 	struct window* superview;
 	array_m* subviews;
+	struct window* window; //always this window, lets a Window be handled as a View
 
 	Size size;
 	char* title;
@@ -5,11 +5,15 @@
 #include <kernel/util/interrupts/isr.h>
 #include <kernel/util/syscall/sysfuncs.h>
 #include <kernel/util/kbman/kbman.h>
+#include <kernel/util/multitasking/tasks/wait_queue.h>
 
 void kb_callback(registers_t regs);
 
 keymap_t* layout;
 
+//tasks blocked in getchar()
+static wait_queue_t kb_waiters;
+
 //index into circular buffer of kb data
 uint32_t kb_buffer_start;
 uint32_t kb_buffer_end;
@@ -39,8 +43,23 @@ char kgetch() {
 }
 
 char getchar() {
-	sys_yield(KB_WAIT);
-	return kgetch();
+	extern task_t* current_task;
+	extern task_t* first_responder;
+
+	//sleep until kb_callback() has buffered a key for us, and we're the task keys are meant for
+	//interrupts stay off between checking the buffer and blocking, so a key can't arrive unnoticed
+	kernel_begin_critical();
+	while (current_task != first_responder || !haskey()) {
+		wait_on(&kb_waiters, KB_WAIT);
+	}
+	char c = kgetch();
+	kernel_end_critical();
+	return c;
+}
+
+void kb_focus_changed() {
+	//tasks in getchar() recheck whether the keys are theirs now
+	wake_all(&kb_waiters);
 }
 
 bool haskey() {
@@ -103,6 +122,9 @@ void kb_callback(registers_t regs) {
 		
 		// if this key was a special key, inform os
 		kbman_process(scancode);
+
+		//key is buffered, whichever task in getchar() has focus takes it
+		wake_all(&kb_waiters);
 	}
 }
 #pragma GCC diagnostic pop
@@ -20,6 +20,8 @@ __BEGIN_DECLS
 char kgetch();
 char getchar();
 bool haskey();
+//called when the first responder changes, so a task blocked in getchar() that just gained focus reads waiting keys
+void kb_focus_changed();
 void kb_install();
 void switch_layout(keymap_t* layout);
 
@@ -4,6 +4,7 @@
 #include <std/std.h>
 #include <kernel/util/multitasking/tasks/task.h>
 #include <kernel/util/syscall/sysfuncs.h>
+#include <kernel/util/multitasking/tasks/wait_queue.h>
 
 typedef unsigned char byte;
 typedef signed char sbyte;
@@ -13,6 +14,11 @@ volatile int running_x = 0;
 volatile int running_y = 0;
 volatile uint8_t mouse_state;
 
+//tasks blocked in mouse_event_wait()
+static wait_queue_t mouse_waiters;
+//number of complete packets received, so waiters can tell whether they've missed any
+static volatile uint32_t mouse_event_count = 0;
+
 Coordinate mouse_point() {
 	static Coordinate previous_pos;
 
@@ -96,10 +102,9 @@ void mouse_callback(registers_t regs) {
 			update_mouse_position(mouse_byte[2], mouse_byte[0]);
 			mouse_cycle = 0;
 
-			//hook into task switch
-			//trigger iosentinel
-			extern void update_blocked_tasks();
-			update_blocked_tasks();
+			//wake anyone waiting for mouse input
+			mouse_event_count++;
+			wake_all(&mouse_waiters);
 			
 			break;
 	}
@@ -173,5 +178,13 @@ void mouse_install() {
 }
 
 void mouse_event_wait() {
-	sys_yield(MOUSE_WAIT);
+	//events which arrived since the last call count, so nothing is dropped while the caller was busy
+	static uint32_t last_seen = 0;
+	//interrupts stay off between checking the count and blocking, so a packet can't arrive unnoticed
+	kernel_begin_critical();
+	while (mouse_event_count == last_seen) {
+		wait_on(&mouse_waiters, MOUSE_WAIT);
+	}
+	last_seen = mouse_event_count;
+	kernel_end_critical();
 }
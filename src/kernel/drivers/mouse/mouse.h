@@ -16,6 +16,7 @@ Coordinate mouse_point();
 uint8_t mouse_events();
 
 //blocks running task until mouse event is recieved
+//returns immediately if an event arrived since the previous call
 void mouse_event_wait();
 
 #endif
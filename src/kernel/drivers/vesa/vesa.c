@@ -13,52 +13,115 @@
 extern page_directory_t* kernel_directory;
 Window* create_window_int(Rect frame, bool root);
 
-//sets up VESA for mode
-Screen* switch_to_vesa(uint32_t vesa_mode, bool create) {
-		kernel_begin_critical();
+//mode attribute bits
+#define VBE_MODE_SUPPORTED	0x01
+#define VBE_MODE_GRAPHICS	0x10
+#define VBE_MODE_LFB		0x80
+//memory model of modes with RGB pixels
+#define VBE_MEM_MODEL_DIRECT	0x06
+//VBE call succeeded
+#define VBE_SUCCESS		0x004F
+//terminates the list of supported modes
+#define VBE_MODE_LIST_END	0xFFFF
+//never scan more modes than this, in case the list is malformed
+#define VBE_MODE_LIST_MAX	256
+
+//BIOS can only write to memory below 1MB, so these are truncated to real-mode addresses
+//TODO figure out why this isn't a pointer
+//things break if we make this a pointer
+static uint32_t info_buffer = 0;
+static uint32_t mode_buffer = 0;
+
+static void vesa_get_info(vesa_info* info) {
+	if (!info_buffer) {
+		info_buffer = (uint32_t)kmalloc(sizeof(vesa_info)) & 0xFFFFF;
+	}
+
+	regs16_t regs;
+	memcpy((void*)info_buffer, "VBE2", 4);
+	memset(&regs, 0, sizeof(regs));
+
+	regs.ax = 0x4F00; //00 gets VESA information
+	regs.di = info_buffer & 0xF;
+	regs.es = (info_buffer >> 4) & 0xFFFF;
+	int32(0x10, &regs);
+
+	//copy info from buffer into struct
+	memcpy(info, (void*)info_buffer, sizeof(vesa_info));
+}
 
-		vesa_info info;
-		vbe_mode_info mode_info;
-		regs16_t regs;
+static void vesa_get_mode_info(uint32_t vesa_mode, vbe_mode_info* mode_info) {
+	if (!mode_buffer) {
+		mode_buffer = (uint32_t)(kmalloc(sizeof(vbe_mode_info))) & 0xFFFFF;
+	}
 
-		//get VESA information
+	regs16_t regs;
+	memset(&regs, 0, sizeof(regs));
 
-		//buffer stores info before being copied into structure
-		uint32_t buffer = (uint32_t)kmalloc(sizeof(vesa_info)) & 0xFFFFF;
+	regs.ax = 0x4F01; //01 gets VBE mode information
+	regs.di = mode_buffer & 0xF;
+	regs.es = (mode_buffer >> 4) & 0xFFFF;
+	regs.cx = vesa_mode; //mode to get info for
+	int32(0x10, &regs);
 
-		memcpy((void*)buffer, "VBE2", 4);
-		memset(&regs, 0, sizeof(regs));
+	//copy mode info from buffer into struct
+	memcpy(mode_info, (void*)mode_buffer, sizeof(vbe_mode_info));
+}
 
-		regs.ax = 0x4F00; //00 gets VESA information
-		regs.di = buffer & 0xF;
-		regs.es = (buffer >> 4) & 0xFFFF;
-		int32(0x10, &regs);
+uint32_t vesa_pick_mode(Size size, uint32_t fallback) {
+	kernel_begin_critical();
 
-		//copy info from buffer into struct
-		memcpy(&info, (void*)buffer, sizeof(vesa_info));
+	vesa_info info;
+	vesa_get_info(&info);
 
-		//get VESA mode information
+	//mode list is a real-mode segment:offset pointer
+	uint32_t list_addr = (((info.video_mode_ptr >> 16) & 0xFFFF) << 4) + (info.video_mode_ptr & 0xFFFF);
+	uint16_t* modes = (uint16_t*)list_addr;
 
-		//buffer to store mode info before copying into structure
-		//TODO figure out why this isn't a pointer
-		//things break if we make this a pointer
-		//but it's a leak ATM
-		uint32_t mode_buffer = (uint32_t)(kmalloc(sizeof(vbe_mode_info))) & 0xFFFFF;
+	uint32_t best = fallback;
+	int best_bpp = 0;
+	uint16_t required = VBE_MODE_SUPPORTED | VBE_MODE_GRAPHICS | VBE_MODE_LFB;
+	for (int i = 0; i < VBE_MODE_LIST_MAX && modes[i] != VBE_MODE_LIST_END; i++) {
+		vbe_mode_info mode_info;
+		vesa_get_mode_info(modes[i], &mode_info);
+
+		if ((mode_info.mode_attributes & required) != required) continue;
+		if (mode_info.x_res != size.width || mode_info.y_res != size.height) continue;
+		if (mode_info.mem_model != VBE_MEM_MODEL_DIRECT) continue;
+		//layers are converted to the framebuffer as XRGB8888 or BGR24
+		if (mode_info.bpp != 32 && mode_info.bpp != 24) continue;
+		if (mode_info.red_mask_pos != 16 || mode_info.green_mask_pos != 8 || mode_info.blue_mask_pos != 0) continue;
+
+		//32bpp framebuffers take layers as-is, so they beat 24bpp
+		if (mode_info.bpp > best_bpp) {
+			best = modes[i];
+			best_bpp = mode_info.bpp;
+		}
+	}
 
-		memset(&regs, 0, sizeof(regs));
-//VESA mode
-		//0x118: 1024x768x24
-		//0x112: 640x400x24
+	kernel_end_critical();
 
-		regs.ax = 0x4F01; //01 gets VBE mode information
-		regs.di = mode_buffer & 0xF;
-		regs.es = (mode_buffer >> 4) & 0xFFFF;
-		regs.cx = vesa_mode; //mode to get info for
-		int32(0x10, &regs);
+	printf_info("VESA: picked mode %x (%dx%dx%d)", best, size.width, size.height, best_bpp ? best_bpp : VESA_DEPTH);
+	return best;
+}
+
+//sets up VESA for mode
+Screen* switch_to_vesa(uint32_t vesa_mode, bool create) {
+		kernel_begin_critical();
+
+		vbe_mode_info mode_info;
+		regs16_t regs;
+
+		//VBE 2.0 needs to be queried before modes can be set
+		vesa_info info;
+		vesa_get_info(&info);
 
-		//copy mode info from buffer into struct
-		memcpy(&mode_info, (uint32_t*)mode_buffer, sizeof(vbe_mode_info));
+		//VESA mode
+		//0x118: 1024x768x24
+		//0x112: 640x480x24
+		vesa_get_mode_info(vesa_mode, &mode_info);
 
+		memset(&regs, 0, sizeof(regs));
 		regs.ax = 0x4F02; //02 sets graphics mode
 
 		//sets up mode with linear frame buffer instead of bank switching
@@ -72,8 +135,74 @@ Screen* switch_to_vesa(uint32_t vesa_mode, bool create) {
 
 		if (create) {
 			Screen* screen = screen_create(size_make(mode_info.x_res, mode_info.y_res), (uint32_t*)mode_info.physbase, mode_info.bpp);
+			//rows may be padded past the visible width
+			screen->pitch = mode_info.bytes_per_scan_line;
+			vesa_setup_page_flip(screen, vesa_mode);
 			return screen;
 		}
 
 		return 0;
 }
+
+bool vesa_set_display_start(uint32_t x, uint32_t y) {
+	kernel_begin_critical();
+
+	regs16_t regs;
+	memset(&regs, 0, sizeof(regs));
+	regs.ax = 0x4F07; //07 sets display start
+	regs.bx = 0x0080; //during vertical retrace, so the switch never tears
+	regs.cx = x; //first pixel in scan line
+	regs.dx = y; //first scan line
+	int32(0x10, &regs);
+
+	kernel_end_critical();
+	return regs.ax == VBE_SUCCESS;
+}
+
+void vesa_setup_page_flip(Screen* screen, uint32_t vesa_mode) {
+	screen->page_count = 1;
+	screen->back_page = 0;
+
+	kernel_begin_critical();
+
+	vbe_mode_info mode_info;
+	vesa_get_mode_info(vesa_mode, &mode_info);
+
+	//count of extra images that fit in video memory
+	bool fits = mode_info.num_image_pages >= 1;
+
+	regs16_t regs;
+	memset(&regs, 0, sizeof(regs));
+	if (fits) {
+		regs.ax = 0x4F06; //06 sets logical scan line length
+		regs.bx = 0x0000; //length given in pixels
+		regs.cx = mode_info.x_res;
+		int32(0x10, &regs);
+	}
+
+	kernel_end_critical();
+
+	//dx reports how many scan lines video memory holds at this length
+	int height = screen->vmem->size.height;
+	if (!fits || regs.ax != VBE_SUCCESS || regs.dx < height * 2) {
+		printf_info("VESA: no room for a second page, presenting by copy");
+		return;
+	}
+	//card may pad scan lines differently once the logical length is set
+	uint16_t pitch = regs.bx;
+	//back page is drawn through the mapping set up at boot, so both pages have to be inside it
+	if (!lfb_mapped(mode_info.physbase, pitch * height * 2)) {
+		printf_info("VESA: second page lies outside the mapped framebuffer, presenting by copy");
+		return;
+	}
+
+	//show the first page, and draw into the second
+	if (!vesa_set_display_start(0, 0)) {
+		printf_info("VESA: display start can't be moved, presenting by copy");
+		return;
+	}
+	screen->pitch = pitch;
+	screen->page_count = 2;
+	screen->back_page = 1;
+	printf_info("VESA: page flipping between 2 pages of %d scan lines", height);
+}
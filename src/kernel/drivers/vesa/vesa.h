@@ -57,5 +57,13 @@ typedef struct vesa_info {
 } vesa_info;
 
 Screen* switch_to_vesa(uint32_t mode, bool create);
+//double the virtual height of mode so screen can flip between two pages in video memory
+//leaves screen presenting by copy if the card can't do it
+void vesa_setup_page_flip(Screen* screen, uint32_t mode);
+//scroll the visible image to start at (x, y) in video memory, during the next vertical retrace
+bool vesa_set_display_start(uint32_t x, uint32_t y);
+//find the deepest linear RGB mode with the given resolution, preferring 32bpp
+//returns fallback if no such mode exists
+uint32_t vesa_pick_mode(Size size, uint32_t fallback);
 
 #endif
@@ -15,6 +15,7 @@
 #include <kernel/util/paging/paging.h>
 #include <kernel/util/multitasking/tasks/task.h>
 #include <kernel/util/mutex/mutex.h>
+#include <kernel/util/fpu/fpu.h>
 #include <kernel/util/vfs/initrd.h>
 #include <kernel/drivers/rtc/clock.h>
 #include <kernel/drivers/pit/pit.h>
@@ -86,6 +87,9 @@ void kernel_main(multiboot* mboot_ptr, uint32_t initial_stack) {
 
 	test_interrupts();
 
+	//enable FPU/SSE before anything can use it
+	fpu_install();
+
 	//timer driver (many functions depend on timer interrupt so start early)
 	pit_install(1000);
 
@@ -111,7 +115,15 @@ void kernel_main(multiboot* mboot_ptr, uint32_t initial_stack) {
 	test_printf();
 	test_time_unique();
 	test_malloc();
+	test_slab();
+	test_heap_coalesce();
+	test_frames();
+	test_cow();
+	test_demand_paging();
+	test_timer();
 	test_crypto();
+	test_blend();
+	test_initrd();
 
 	if (!fork("shell")) {
 		//start shell
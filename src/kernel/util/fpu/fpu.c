@@ -0,0 +1,55 @@
+#include "fpu.h"
+#include <std/std.h>
+
+//CPUID leaf 1 EDX feature bits
+#define CPUID_FEAT_FXSR	(1 << 24)
+#define CPUID_FEAT_SSE	(1 << 25)
+#define CPUID_FEAT_SSE2	(1 << 26)
+
+#define CR0_MP		(1 << 1) //monitor coprocessor
+#define CR0_EM		(1 << 2) //emulate coprocessor, makes every FPU instruction fault
+#define CR4_OSFXSR	(1 << 9) //OS supports fxsave/fxrstor and SSE
+#define CR4_OSXMMEXCPT	(1 << 10) //OS handles unmasked SSE exceptions
+
+static bool fxsr_enabled = false;
+static bool sse2_enabled = false;
+
+void fpu_install() {
+	uint32_t eax, edx;
+	cpuid(1, &eax, &edx);
+
+	uint32_t cr0;
+	asm volatile("mov %%cr0, %0" : "=r"(cr0));
+	cr0 &= ~CR0_EM;
+	cr0 |= CR0_MP;
+	asm volatile("mov %0, %%cr0" : : "r"(cr0));
+	asm volatile("fninit");
+
+	if (!(edx & CPUID_FEAT_FXSR)) {
+		printf_info("FPU: no fxsave support, SSE disabled");
+		return;
+	}
+
+	uint32_t cr4;
+	asm volatile("mov %%cr4, %0" : "=r"(cr4));
+	cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+	asm volatile("mov %0, %%cr4" : : "r"(cr4));
+	fxsr_enabled = true;
+
+	sse2_enabled = (edx & CPUID_FEAT_SSE) && (edx & CPUID_FEAT_SSE2);
+	printf_info("FPU: SSE2 %s", sse2_enabled ? "enabled" : "unsupported");
+}
+
+bool fpu_sse2_enabled() {
+	return sse2_enabled;
+}
+
+void fpu_save(uint8_t* state) {
+	if (!fxsr_enabled) return;
+	asm volatile("fxsave (%0)" : : "r"(state) : "memory");
+}
+
+void fpu_restore(uint8_t* state) {
+	if (!fxsr_enabled) return;
+	asm volatile("fxrstor (%0)" : : "r"(state) : "memory");
+}
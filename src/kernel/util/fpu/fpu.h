@@ -0,0 +1,25 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <std/common.h>
+#include <stdbool.h>
+
+//bytes written by fxsave
+#define FPU_STATE_SIZE 512
+//fxsave needs its buffer 16-byte aligned
+#define FPU_STATE_ALIGN 16
+
+//enables the x87 FPU, and SSE if the CPU supports it
+//must run before any task touches floating point or SSE registers
+void fpu_install();
+
+//true once SSE2 instructions are safe to execute
+bool fpu_sse2_enabled();
+
+//save or restore the x87 and SSE registers to/from state
+//state must be FPU_STATE_SIZE bytes and FPU_STATE_ALIGN aligned
+//these do nothing if the CPU can't fxsave
+void fpu_save(uint8_t* state);
+void fpu_restore(uint8_t* state);
+
+#endif
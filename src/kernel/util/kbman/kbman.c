@@ -23,10 +23,6 @@ void kbman_process(char c) {
 		default:
 			break;
 	}
-
-	//inform scheduler that a keystroke has been recieved
-	//this call forces any tasks waiting on a keystroke to be woken
-	force_enumerate_blocked();
 }
 
 void kbman_process_release(char c) {
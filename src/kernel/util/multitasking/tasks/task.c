@@ -24,7 +24,7 @@ void task_switch_real(uint32_t eip, uint32_t paging_dir, uint32_t ebp, uint32_t
 #define MAX_FILES 32
 
 #define MLFQ_DEFAULT_QUEUE_COUNT 16
-#define MLFQ_MAX_QUEUE_LENGTH 16
+#define MLFQ_MAX_QUEUE_COUNT 32
 
 #define HIGH_PRIO_QUANTUM 5
 #define BOOSTER_PERIOD 1000
@@ -35,13 +35,32 @@ extern page_directory_t* current_directory;
 
 static int next_pid = 1;
 task_t* current_task = 0;
-static array_m* queues = 0;
-static array_m* queue_lifetimes = 0;
+//runnable tasks on each queue, in round-robin order
+//blocked tasks are kept off these lists entirely
+static task_t* run_heads[MLFQ_MAX_QUEUE_COUNT];
+static task_t* run_tails[MLFQ_MAX_QUEUE_COUNT];
+//bit n is set if queue n has any runnable tasks
+static uint32_t run_bitmap = 0;
+static int queue_count = 0;
+static uint32_t queue_lifetimes[MLFQ_MAX_QUEUE_COUNT];
 static task_t* active_list = 0;
 
 task_t* first_responder = 0;
 static array_m* responder_stack = 0;
 
+//fork latency counters, in CPU cycles
+static uint32_t fork_count = 0;
+static uint32_t fork_last_cycles = 0;
+static uint32_t fork_max_cycles = 0;
+
+//low 32 bits of timestamp counter
+//plenty for timing anything shorter than a second
+static inline uint32_t rdtsc_low() {
+	uint32_t low, high;
+	asm volatile("rdtsc" : "=a"(low), "=d"(high));
+	return low;
+}
+
 void enqueue_task(task_t* task, int queue);
 void dequeue_task(task_t* task);
 
@@ -68,7 +87,7 @@ void unlist_task(task_t* task) {
 		//walk linked list
 		task_t* prev = active_list;
 		task_t* current = prev->next;
-		while (current->next != NULL) {
+		while (current != NULL) {
 			if (current == task) {
 				break;
 			}
@@ -99,11 +118,52 @@ void list_task(task_t* task) {
 	current->next = task;
 }
 
+static bool run_queued(task_t* task) {
+	return task->run_prev || task->run_next || run_heads[task->queue] == task;
+}
+
+static void run_push(task_t* task) {
+	int queue = task->queue;
+	task->run_next = NULL;
+	task->run_prev = run_tails[queue];
+	if (run_tails[queue]) {
+		run_tails[queue]->run_next = task;
+	}
+	else {
+		run_heads[queue] = task;
+	}
+	run_tails[queue] = task;
+	run_bitmap |= (1 << queue);
+}
+
+static void run_remove(task_t* task) {
+	int queue = task->queue;
+	if (task->run_prev) {
+		task->run_prev->run_next = task->run_next;
+	}
+	else {
+		run_heads[queue] = task->run_next;
+	}
+	if (task->run_next) {
+		task->run_next->run_prev = task->run_prev;
+	}
+	else {
+		run_tails[queue] = task->run_prev;
+	}
+	task->run_prev = task->run_next = NULL;
+
+	if (!run_heads[queue]) {
+		run_bitmap &= ~(1 << queue);
+	}
+}
+
 void block_task(task_t* task, task_state reason) {
 	if (!tasking_installed()) return;
 
 	kernel_begin_critical();
 	task->state = reason;
+	//blocked tasks don't sit on run queues
+	dequeue_task(task);
 	kernel_end_critical();
 
 	//immediately switch tasks if active task was just blocked
@@ -116,10 +176,20 @@ void unblock_task(task_t* task) {
 	if (!tasking_installed()) return;
 
 	kernel_begin_critical();
-	task->state = RUNNABLE;
+	if (task->state != RUNNABLE) {
+		task->state = RUNNABLE;
+		//rejoin the back of the queue it was on when it blocked
+		run_push(task);
+	}
 	kernel_end_critical();
 }
 
+//fxsave area within task's padded buffer, kmalloc doesn't promise 16-byte alignment
+static uint8_t* task_fpu_state(task_t* task) {
+	uint32_t addr = (uint32_t)task->fpu_state;
+	return (uint8_t*)((addr + FPU_STATE_ALIGN - 1) & ~(FPU_STATE_ALIGN - 1));
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 task_t* create_process(char* name, uint32_t eip, bool wants_stack) {
@@ -135,6 +205,8 @@ task_t* create_process(char* name, uint32_t eip, bool wants_stack) {
 	task->id = next_pid++;
 	task->page_dir = cloned;
 	setup_fds(task);
+	//child starts with a copy of parent's FPU/SSE registers, like the rest of its state
+	fpu_save(task_fpu_state(task));
 
 	uint32_t current_eip = read_eip();
 	if (current_task == parent) {
@@ -182,32 +254,9 @@ void reap() {
 		task_t* tmp = active_list;
 		while (tmp != NULL) {
 			if (tmp->state == ZOMBIE) {
-				array_m* queue = array_m_lookup(queues, tmp->queue);
-				int idx = array_m_index(queue, tmp);
-				if (idx != ARR_NOT_FOUND) {
-					array_m_remove(queue, idx);
-					unlist_task(tmp);
-				}
-				else {
-					//couldn't find task in the queue it said it was in
-					//fall back on searching through each queue
-					bool found = false;
-					for (int i = 0; i < queues->size && !found; i++) {
-						array_m* queue = array_m_lookup(queues, i);
-						for (int j = 0; j < queues->size && !found; j++) {
-							task_t* to_test = array_m_lookup(queue, j);
-							if (to_test == tmp) {
-								array_m_remove(queue, j);
-								destroy_task(tmp);
-								found = true;
-								break;
-							}
-						}
-					}
-					if (!found) {
-						printf_err("Tried to reap task %s[%d] but it didn't exist in a queue", tmp->name, tmp->id);
-					}
-				}
+				//zombies were taken off their run queue when they were blocked
+				dequeue_task(tmp);
+				unlist_task(tmp);
 			}
 			tmp = tmp->next;
 		}
@@ -218,72 +267,37 @@ void reap() {
 	}
 }
 
-void iosent() {
-	while (1) {
-		update_blocked_tasks();
-		//yield cpu to next task
-		sys_yield(RUNNABLE);
-	}
-}
-
 void enqueue_task(task_t* task, int queue) {
 	kernel_begin_critical();
-	if (queue < 0 || queue >= queues->size) {
+	if (queue < 0 || queue >= queue_count) {
 		ASSERT(0, "Tried to insert %s into invalid queue %d", task->name, queue);
 	}
 
-	array_m* raw = array_m_lookup(queues, queue);
-
-	//ensure task does not already exist in this queue
-	if (array_m_index(raw, task) == ARR_NOT_FOUND) {
-		array_m_insert(raw, task);
-		task->queue = queue;
-		//new queue, reset lifespan
-		task->lifespan = 0;
+	//ensure task does not already exist in a queue
+	if (run_queued(task)) {
+		printf_err("Tried to enqueue %s onto queue %d while it was in queue %d", task->name, queue, task->queue);
+		kernel_end_critical();
+		return;
 	}
-	else {
-		printf_err("Tried to enqueue %s onto queue where it already existed (%d)", task->name, queue);
+
+	task->queue = queue;
+	//new queue, reset lifespan
+	task->lifespan = 0;
+	//blocked tasks only remember their queue, they join it once they're unblocked
+	if (task->state == RUNNABLE) {
+		run_push(task);
 	}
 	kernel_end_critical();
 }
 
 void dequeue_task(task_t* task) {
 	kernel_begin_critical();
-	if (task->queue < 0 || task->queue >= queues->size) {
+	if (task->queue < 0 || task->queue >= queue_count) {
 		ASSERT(0, "Tried to remove %s from invalid queue %d", task->name, task->queue);
 	}
-	array_m* raw = array_m_lookup(queues, task->queue);
-
-	int idx = array_m_index(raw, task);
-	if (idx < 0) {
-		printf_err("Tried to dequeue %s from queue %d it didn't belong to!", task->name, task->queue);
-		//fall back on searching all queues for this task
-		for (int i = 0; i < queues->size; i++) {
-			array_m* queue = array_m_lookup(queues, i);
-			for (int j = 0; j < queue->size; j++) {
-				task_t* tmp = array_m_lookup(queue, j);
-				if (task == tmp) {
-					//found task we were looking for
-					printf_info("Task was actually in queue %d", i);
-					array_m_remove(queue, j);
-					kernel_end_critical();
-					return;
-				}
-			}
-		}
-		//never found the task!
-		printf_err("Task %s did not exist in any queues!", task->name);
-		return;
-	}
-
-	array_m_remove(raw, idx);
-
-	//if for some reason this task is still in the queue (if it was added to queue twice),
-	//dequeue it again
-	if (array_m_index(raw, task) != ARR_NOT_FOUND) {
-		dequeue_task(task);
+	if (run_queued(task)) {
+		run_remove(task);
 	}
-
 	kernel_end_critical();
 }
 
@@ -296,7 +310,7 @@ void switch_queue(task_t* task, int new) {
 
 void demote_task(task_t* task) {
 	//if we're already at the bottom task, don't attempt to demote further
-	if (task->queue >= queues->size - 1) {
+	if (task->queue >= queue_count - 1) {
 		return;
 	}
 	switch_queue(task, task->queue + 1);
@@ -307,7 +321,7 @@ void promote_task(task_t* task) {
 }
 
 bool tasking_installed() {
-	return (queues && queues->size >= 1 && current_task);
+	return (queue_count >= 1 && current_task);
 }
 
 void booster() {
@@ -329,7 +343,6 @@ void tasking_install(mlfq_option options) {
 
 	move_stack((void*)0xE0000000, 0x2000);
 
-	int queue_count = 0;
 	switch (options) {
 		case LOW_LATENCY:
 			queue_count = 1;
@@ -340,15 +353,8 @@ void tasking_install(mlfq_option options) {
 			break;
 	}
 
-	queues = array_m_create(queue_count + 1);
-	for (int i = 0; i < queue_count; i++) {
-		array_m* queue = array_m_create(MLFQ_MAX_QUEUE_LENGTH);
-		array_m_insert(queues, queue);
-	}
-
-	queue_lifetimes = array_m_create(queue_count + 1);
 	for (int i = 0; i < queue_count; i++) {
-		array_m_insert(queue_lifetimes, (type_t)(HIGH_PRIO_QUANTUM * (i + 1)));
+		queue_lifetimes[i] = HIGH_PRIO_QUANTUM * (i + 1);
 	}
 
 	//init first task (kernel task)
@@ -384,52 +390,12 @@ void tasking_install(mlfq_option options) {
 		reap();
 	}
 
-	//blocked task sentinel
-	//watches system events and wakes threads as necessary
-	if (!fork("iosentinel")) {
-		iosent();
-	}
-
 	//reenable interrupts
 	kernel_end_critical();
 
 	printf_info("Tasking initialized with kernel PID %d", getpid());
 }
 
-void update_blocked_tasks() {
-	if (!tasking_installed()) return;
-
-	kernel_begin_critical();
-
-	//if there is a pending key, wake first responder
-	if (haskey() && first_responder->state == KB_WAIT) {
-		unblock_task(first_responder);
-		goto_pid(first_responder->id);
-	}
-
-	//wake blocked tasks if the event they were blocked for has occurred
-	//TODO is this optimizable?
-	//don't look through every queue, use linked list of tasks
-	task_t* task = active_list;
-	while (task) {
-		if (task->state == PIT_WAIT) {
-			if (time() >= task->wake_timestamp) {
-				unblock_task(task);
-			}
-		}
-
-		//TODO figure out when exactly tasks with MOUSE_WAIT should be unblocked
-		if (task->state == MOUSE_WAIT) {
-			unblock_task(task);
-			goto_pid(task->id);
-		}
-
-		task = task->next;
-	}
-
-	kernel_end_critical();
-}
-
 int fork(char* name) {
 	if (!tasking_installed()) return 0; //TODO: check this result
 
@@ -438,6 +404,7 @@ int fork(char* name) {
 	//keep reference to parent for later
 	task_t* parent = current_task;
 
+	uint32_t fork_start = rdtsc_low();
 	task_t* child = create_process(name, 0, false);
 	add_process(child);
 
@@ -458,6 +425,10 @@ int fork(char* name) {
 		child->ebp = ebp;
 		child->eip = eip;
 
+		fork_last_cycles = rdtsc_low() - fork_start;
+		fork_max_cycles = MAX(fork_max_cycles, fork_last_cycles);
+		fork_count++;
+
 		kernel_end_critical();
 
 		//return child PID by convention
@@ -470,129 +441,33 @@ int fork(char* name) {
 	}
 }
 
-task_t* first_queue_runnable(array_m* queue, int offset) {
-	for (int i = offset; i < queue->size; i++) {
-		task_t* tmp = array_m_lookup(queue, i);
-		if (tmp->state == RUNNABLE) {
-			return tmp;
-		}
-	}
-	//no runnable tasks within this queue!
-	return NULL;
-}
-
-array_m* first_queue_containing_runnable(void) {
-	//we could look at every queue individually, but that would be slow
-	//let's take advantage of our linked list of tasks and search that
-	task_t* curr = active_list;
-	task_t* highest_prio_runnable = NULL;
-
-	//TODO figure out why this block doesn't work
-	while (curr) {
-		if (curr->state == RUNNABLE) {
-			//if this task has a higher priority (lower queue #), or this is the first runnable task we've found,
-			//mark it as best
-			if (!highest_prio_runnable || curr->queue < highest_prio_runnable->queue) {
-				highest_prio_runnable = curr;
-			}
-		}
-		curr = curr->next;
-	}
-
-	array_m* queue = array_m_lookup(queues, highest_prio_runnable->queue);
-	if (!highest_prio_runnable || highest_prio_runnable->state != RUNNABLE || !queue->size) {
-	//if (1) {
-		//printf_err("Couldn't find runnable task in linked list of tasks!");
-		for (int i = 0; i < queues->size; i++) {
-			array_m* tmp = array_m_lookup(queues, i);
-			if (first_queue_runnable(tmp, 0) != NULL) {
-				return tmp;
-			}
-		}
-	}
-	//no queues contained any runnable tasks!
-	if (!highest_prio_runnable) {
-		proc();
-		ASSERT(highest_prio_runnable, "No queues contained any runnable tasks!");
-	}
-
-	return queue;
-}
-
 task_t* mlfq_schedule() {
 	if (!tasking_installed()) return NULL;
 
-	//find current index in queue
-	array_m* current_queue = array_m_lookup(queues, current_task->queue);
-	int current_task_idx = array_m_index(current_queue, current_task);
-	if (current_task_idx < 0) {
-		ASSERT(0, "Couldn't find current task in queue %d", current_task->queue);
-	}
-
 	//increment lifespan by how long this task ran
 	if (current_task->relinquish_date && current_task->begin_date) {
 		current_task->lifespan += (current_task->relinquish_date - current_task->begin_date);
 	}
 
-	if (current_task->lifespan >= (uint32_t)array_m_lookup(queue_lifetimes, current_task->queue)) {
+	if (current_task->lifespan >= queue_lifetimes[current_task->queue] && current_task->queue < queue_count - 1) {
+		//demoting puts task at the back of the lower queue
 		demote_task(current_task);
 	}
-
-	//if we're running in low-latency mode, save time by just using round-robin
-	if (queues->size == 1) {
-		//attempt to save time by first looking at the next task in linked list
-		task_t* next = current_task->next;
-		if (!next) next = active_list;
-		while (next->state != RUNNABLE) {
-			next = next->next;
-			if (!next) {
-				next = active_list;
-			}
-		}
-		ASSERT(next, "Couldn't find valid runnable task!");
-		return next;
+	else if (run_queued(current_task)) {
+		//round-robin, current task goes to the back of its queue
+		run_remove(current_task);
+		run_push(current_task);
 	}
 
-	//find first non-empty queue
-	array_m* new_queue = first_queue_containing_runnable();
-	if (!new_queue->size) {
+	//first task on highest priority non-empty queue
+	if (!run_bitmap) {
 		proc();
+		ASSERT(0, "No queues contained any runnable tasks!");
 	}
-	ASSERT(new_queue->size, "Couldn't find any queues with tasks to run in queue %d!", array_m_index(queues, new_queue));
-
-	if (new_queue->size >= 1) {
-		//round-robin through this queue
-
-		//if this is the same queue as the previous task, start at that index
-		if (current_queue == new_queue) {
-			//if this is the last index, loop around to the start of the array
-			if (current_task_idx + 1 >= new_queue->size) {
-				task_t* valid = first_queue_runnable(new_queue, 0);
-				if (valid != NULL) {
-					return valid;
-				}
-			}
-			//return task at the next index
-			task_t* valid = first_queue_runnable(new_queue, current_task_idx + 1);
-			if (valid != NULL) {
-				return valid;
-			}
-		}
-
-		//we're on a new queue
-		//start from the first task in it
-		task_t* valid = first_queue_runnable(new_queue, 0);
-		if (valid != NULL) {
-			return valid;
-		}
-	}
-	ASSERT(0, "Couldn't find task to switch to!");
+	return run_heads[__builtin_ctz(run_bitmap)];
 }
 
-void goto_pid(int id) {
-	if (!current_task || !queues) {
-		return;
-	}
+static void switch_to_task(task_t* next) {
 	kernel_begin_critical();
 
 	//read esp, ebp now for saving later
@@ -616,51 +491,40 @@ void goto_pid(int id) {
 	current_task->eip = eip;
 	current_task->esp = esp;
 	current_task->ebp = ebp;
+	fpu_save(task_fpu_state(current_task));
+
+	current_task = next;
+	current_task->begin_date = time();
+	int lifetime = queue_lifetimes[current_task->queue];
+	current_task->end_date = current_task->begin_date + lifetime;
+
+	eip = current_task->eip;
+	esp = current_task->esp;
+	ebp = current_task->ebp;
+	current_directory = current_task->page_dir;
+	fpu_restore(task_fpu_state(current_task));
+	task_switch_real(eip, current_directory->physicalAddr, ebp, esp);
+}
+
+void goto_pid(int id) {
+	if (!current_task || !queue_count) {
+		return;
+	}
+	kernel_begin_critical();
 
 	//find task with this PID
-	bool found_task = false;
 	task_t* tmp = active_list;
 	while (tmp != NULL) {
 		if (tmp->id == id && tmp->state == RUNNABLE) {
 			//switch to PID passed to us
-			current_task = tmp;
-			found_task = true;
-			break;
+			switch_to_task(tmp);
+			return;
 		}
 		tmp = tmp->next;
 	}
 
-	if (!found_task) {
-		printf_err("PID %d wasn't in active list, falling back on queue search", id);
-		//fall back on searching through each queue for this task
-		for (int i = 0; i < queues->size; i++) {
-			array_m* tasks = array_m_lookup(queues, i);
-			for (int j = 0; j < tasks->size; j++) {
-				task_t* tmp = array_m_lookup(tasks, j);
-				if (tmp->id == id) {
-					current_task = tmp;
-					found_task = true;
-					break;
-				}
-			}
-		}
-
-		//did we still not find it?
-		if (!found_task) {
-			printf_err("goto_pid: Nonexistant PID %d!", id);
-			ASSERT(0, "Invalid context switch state");
-		}
-	}
-
-	current_task->begin_date = time();
-	int lifetime = (int)array_m_lookup(queue_lifetimes, current_task->queue);
-	current_task->end_date = current_task->begin_date + lifetime;
-
-	eip = current_task->eip;
-	esp = current_task->esp;
-	ebp = current_task->ebp;
-	current_directory = current_task->page_dir;
-	task_switch_real(eip, current_directory->physicalAddr, ebp, esp);
+	printf_err("goto_pid: Nonexistant PID %d!", id);
+	ASSERT(0, "Invalid context switch state");
 }
 
 uint32_t task_switch() {
@@ -674,7 +538,7 @@ uint32_t task_switch() {
 
 	kernel_end_critical();
 
-	goto_pid(next->id);
+	switch_to_task(next);
 
 	//TODO: what should be returned here?
 	return 0;
@@ -704,7 +568,7 @@ void handle_pit_tick() {
 	}
 	if (tick >= last_boost + BOOSTER_PERIOD) {
 		//don't boost if we're in low latency mode!
-		if (queues->size > 1) {
+		if (queue_count > 1) {
 			last_boost = tick;
 			booster();
 		}
@@ -724,43 +588,39 @@ void proc() {
 
 	printf("-----------------------proc-----------------------\n");
 
-	for (int i = 0; i < queues->size; i++) {
-		array_m* queue = array_m_lookup(queues, i);
-		for (int j = 0; j < queue->size; j++) {
-			task_t* task = array_m_lookup(queue, j);
-			uint32_t runtime = (uint32_t)array_m_lookup(queue_lifetimes, task->queue);
-			printf("[%d Q %d] %s ", task->id, task->queue, task->name);
-			if (task == current_task) {
-				printf("(active");
-			}
-			else {
-				printf("used");
-			}
-			printf(" %d/%d ms) ", task->lifespan, runtime);
-
-			switch (task->state) {
-				case RUNNABLE:
-					printf("(runnable)");
-					break;
-				case KB_WAIT:
-					printf("(blocked by keyboard)");
-					break;
-				case PIT_WAIT:
-					printf("(blocked by timer, wakes %d)", task->wake_timestamp);
-					break;
-				default:
-					break;
+	//blocked tasks aren't on any run queue, so walk every task
+	for (task_t* task = active_list; task != NULL; task = task->next) {
+		uint32_t runtime = queue_lifetimes[task->queue];
+		printf("[%d Q %d] %s ", task->id, task->queue, task->name);
+		if (task == current_task) {
+			printf("(active");
 		}
-			printf("\n");
+		else {
+			printf("(used");
 		}
-	}
-	printf("---------------------------------------------------\n");
-}
+		printf(" %d/%d ms, %d faults) ", task->lifespan, runtime, task->page_faults);
 
-void force_enumerate_blocked() {
-	if (!tasking_installed()) return;
+		switch (task->state) {
+			case RUNNABLE:
+				printf("(runnable)");
+				break;
+			case KB_WAIT:
+				printf("(blocked by keyboard)");
+				break;
+			case PIT_WAIT:
+				printf("(blocked by timer, wakes %d)", task->wake_timestamp);
+				break;
+			default:
+				break;
+		}
+		printf("\n");
+	}
 
-	update_blocked_tasks();
+	cow_stats_t cow = cow_stats();
+	printf("%d forks, last took %d cycles, slowest %d cycles\n", fork_count, fork_last_cycles, fork_max_cycles);
+	printf("%d pages backed on demand\n", demand_fault_count());
+	printf("%d pages shared copy-on-write, %d copied, %d write faults\n", cow.pages_shared, cow.pages_copied, cow.write_faults);
+	printf("---------------------------------------------------\n");
 }
 
 void become_first_responder() {
@@ -778,6 +638,7 @@ void become_first_responder() {
 
 	//append this task to stack of responders
 	array_m_insert(responder_stack, first_responder);
+	kb_focus_changed();
 }
 
 void resign_first_responder() {
@@ -786,4 +647,5 @@ void resign_first_responder() {
 	array_m_remove(responder_stack, last_idx);
 	//set first responder to new head of stack
 	first_responder = array_m_lookup(responder_stack, responder_stack->size - 1);
+	kb_focus_changed();
 }
@@ -3,6 +3,7 @@
 
 #include <std/std.h>
 #include <kernel/util/paging/paging.h>
+#include <kernel/util/fpu/fpu.h>
 #include <std/array_l.h>
 
 #define KERNEL_STACK_SIZE 2048 //use 2kb kernel stack
@@ -26,7 +27,7 @@ typedef struct task {
 	int queue; //scheduler ring this task is slotted in
 
 	task_state state; //current process state
-    uint32_t wake_timestamp; //used if process is in PIT_WAIT state
+    uint32_t wake_timestamp; //used if process is in PIT_WAIT state, for display only
 
 	uint32_t begin_date;
 	uint32_t end_date;
@@ -35,11 +36,19 @@ typedef struct task {
 	uint32_t lifespan;
 	struct task* next;
 
+	struct task* run_prev; //neighbours on this task's run queue
+	struct task* run_next;
+	struct task* wait_next; //next task on the wait queue this task is blocked on
+
 	uint32_t esp; //stack pointer
 	uint32_t ebp; //base pointer
 	uint32_t eip; //instruction pointer
+	//x87/SSE registers saved with fxsave while switched out
+	//padded so an aligned FPU_STATE_SIZE area always fits, see task_fpu_state()
+	uint8_t fpu_state[FPU_STATE_SIZE + FPU_STATE_ALIGN];
 
 	page_directory_t* page_dir; //paging directory for this process
+	uint32_t page_faults; //pages backed on demand while this task was running
 
 	array_m* files;
 } task_t;
@@ -49,6 +58,8 @@ void tasking_install();
 bool tasking_installed();
 
 void block_task(task_t* task, task_state reason);
+//marks blocked task as runnable and puts it back on its run queue
+void unblock_task(task_t* task);
 
 //initialize a new process structure
 //does not add returned process to running queue
@@ -67,21 +78,12 @@ int fork();
 //stop executing the current process and remove it from active processes
 void _kill();
 
-//used whenever a system event occurs
-//looks at blocked tasks and unblocks as necessary
-void update_blocked_tasks();
-
 //returns pid of current process
 int getpid();
 
 //print all active processes
 void proc();
 
-//used to immediately invoke iosentinel process
-//to wake any processes that were waiting on an i/o event that
-//has now been recieved
-void force_enumerate_blocked();
-
 //appends current task to stack of responders,
 //and marks current task as designated recipient of keyboard events
 void become_first_responder();
@@ -0,0 +1,44 @@
+#include "wait_queue.h"
+
+extern task_t* current_task;
+
+void wait_on(wait_queue_t* queue, task_state reason) {
+	//no scheduler to block us, so just wait for the next interrupt
+	//sti only takes effect after the next instruction, so an interrupt can't slip in before the hlt
+	if (!tasking_installed()) {
+		asm volatile("sti; hlt");
+		kernel_begin_critical();
+		return;
+	}
+
+	current_task->wait_next = NULL;
+	if (queue->tail) {
+		queue->tail->wait_next = current_task;
+	}
+	else {
+		queue->head = current_task;
+	}
+	queue->tail = current_task;
+
+	//block_task turns interrupts back on once we're marked blocked, so a wakeup from here on finds us
+	block_task(current_task, reason);
+	//hand back to the caller the way it called us, so it can recheck its condition safely
+	kernel_begin_critical();
+}
+
+void wake_all(wait_queue_t* queue) {
+	kernel_begin_critical();
+
+	task_t* task = queue->head;
+	queue->head = NULL;
+	queue->tail = NULL;
+
+	while (task) {
+		task_t* next = task->wait_next;
+		task->wait_next = NULL;
+		unblock_task(task);
+		task = next;
+	}
+
+	kernel_end_critical();
+}
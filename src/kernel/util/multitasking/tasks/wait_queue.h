@@ -0,0 +1,26 @@
+#ifndef WAIT_QUEUE_H
+#define WAIT_QUEUE_H
+
+#include "task.h"
+
+//list of tasks blocked until some event occurs
+//tasks are linked through task_t, so waiting never allocates
+typedef struct wait_queue {
+	task_t* head;
+	task_t* tail;
+} wait_queue_t;
+
+//blocks current task with state reason until queue is woken
+//must be called with interrupts off, and returns with them still off, so an event can't arrive
+//between the caller checking its condition and blocking:
+//	kernel_begin_critical();
+//	while (!condition) wait_on(&queue, reason);
+//	kernel_end_critical();
+//callers should recheck their condition afterwards, as every waiter is woken at once
+void wait_on(wait_queue_t* queue, task_state reason);
+
+//unblocks every task waiting on queue
+//safe to call from IRQ context
+void wake_all(wait_queue_t* queue);
+
+#endif
@@ -0,0 +1,158 @@
+#include "buddy.h"
+#include <std/kheap.h>
+#include <std/std.h>
+#include <std/printf.h>
+
+static uint32_t total_frames;
+static uint32_t free_frames;
+
+//per frame links, only meaningful for the first frame of a free block
+static uint32_t* next_free;
+static uint32_t* prev_free;
+//per frame, 0 if frame doesn't start a free block, otherwise order of the block + 1
+static uint8_t* block_state;
+
+//free blocks of each order, and bitmap of which orders have any
+static uint32_t free_heads[BUDDY_MAX_ORDER + 1];
+static uint32_t order_map;
+
+static void block_push(uint32_t frame, uint32_t order) {
+	block_state[frame] = order + 1;
+	prev_free[frame] = BUDDY_NONE;
+	next_free[frame] = free_heads[order];
+	if (free_heads[order] != BUDDY_NONE) {
+		prev_free[free_heads[order]] = frame;
+	}
+	free_heads[order] = frame;
+	order_map |= (1 << order);
+}
+
+static void block_remove(uint32_t frame, uint32_t order) {
+	if (prev_free[frame] != BUDDY_NONE) {
+		next_free[prev_free[frame]] = next_free[frame];
+	}
+	else {
+		free_heads[order] = next_free[frame];
+	}
+	if (next_free[frame] != BUDDY_NONE) {
+		prev_free[next_free[frame]] = prev_free[frame];
+	}
+	block_state[frame] = 0;
+
+	if (free_heads[order] == BUDDY_NONE) {
+		order_map &= ~(1 << order);
+	}
+}
+
+//finds free block containing frame
+//returns first frame of block and sets order, or BUDDY_NONE if frame is in use
+static uint32_t containing_block(uint32_t frame, uint32_t* order) {
+	for (uint32_t o = 0; o <= BUDDY_MAX_ORDER; o++) {
+		uint32_t head = frame & ~((1 << o) - 1);
+		if (block_state[head] == o + 1) {
+			*order = o;
+			return head;
+		}
+	}
+	return BUDDY_NONE;
+}
+
+void buddy_init(uint32_t nframes) {
+	total_frames = nframes;
+	free_frames = 0;
+	order_map = 0;
+
+	next_free = (uint32_t*)kmalloc(nframes * sizeof(uint32_t));
+	prev_free = (uint32_t*)kmalloc(nframes * sizeof(uint32_t));
+	block_state = (uint8_t*)kmalloc(nframes * sizeof(uint8_t));
+	memset(block_state, 0, nframes * sizeof(uint8_t));
+
+	for (int i = 0; i <= BUDDY_MAX_ORDER; i++) {
+		free_heads[i] = BUDDY_NONE;
+	}
+
+	//cover every frame with the largest naturally aligned blocks that fit
+	uint32_t frame = 0;
+	while (frame < nframes) {
+		uint32_t order = BUDDY_MAX_ORDER;
+		while ((frame & ((1 << order) - 1)) || frame + (1 << order) > nframes) {
+			order--;
+		}
+		block_push(frame, order);
+		free_frames += 1 << order;
+		frame += 1 << order;
+	}
+}
+
+uint32_t buddy_alloc(uint32_t order) {
+	if (order > BUDDY_MAX_ORDER) return BUDDY_NONE;
+
+	//smallest order at least as big as the request which has a free block
+	uint32_t candidates = order_map & ~((1 << order) - 1);
+	if (!candidates) return BUDDY_NONE;
+	uint32_t o = __builtin_ctz(candidates);
+
+	uint32_t frame = free_heads[o];
+	block_remove(frame, o);
+
+	//split off upper halves until block is the requested size
+	while (o > order) {
+		o--;
+		block_push(frame + (1 << o), o);
+	}
+
+	free_frames -= 1 << order;
+	return frame;
+}
+
+void buddy_free(uint32_t frame, uint32_t order) {
+	ASSERT(frame + (1 << order) <= total_frames, "buddy_free(): frame %x out of range", frame);
+
+	uint32_t existing;
+	if (containing_block(frame, &existing) != BUDDY_NONE) {
+		printf_err("buddy_free(): frame %x was already free", frame);
+		return;
+	}
+	free_frames += 1 << order;
+
+	//merge with buddy for as long as it's also free and the same size
+	while (order < BUDDY_MAX_ORDER) {
+		uint32_t buddy = frame ^ (1 << order);
+		if (buddy >= total_frames || block_state[buddy] != order + 1) break;
+
+		block_remove(buddy, order);
+		frame &= ~(1 << order);
+		order++;
+	}
+	block_push(frame, order);
+}
+
+bool buddy_reserve(uint32_t frame) {
+	if (frame >= total_frames) return false;
+
+	uint32_t order;
+	uint32_t head = containing_block(frame, &order);
+	if (head == BUDDY_NONE) return false;
+
+	block_remove(head, order);
+
+	//split block, giving back every half which doesn't contain frame
+	while (order > 0) {
+		order--;
+		uint32_t half = 1 << order;
+		if (frame >= head + half) {
+			block_push(head, order);
+			head += half;
+		}
+		else {
+			block_push(head + half, order);
+		}
+	}
+
+	free_frames--;
+	return true;
+}
+
+uint32_t buddy_free_count() {
+	return free_frames;
+}
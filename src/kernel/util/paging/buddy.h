@@ -0,0 +1,31 @@
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include <std/common.h>
+#include <stdbool.h>
+
+//blocks are runs of 2^order physically contiguous frames
+//largest block is 2^BUDDY_MAX_ORDER frames (4MB)
+#define BUDDY_MAX_ORDER	10
+//returned by buddy_alloc when no block is available
+#define BUDDY_NONE	0xFFFFFFFF
+
+//sets up allocator for frames [0, nframes), all initially free
+void buddy_init(uint32_t nframes);
+
+//allocates a naturally aligned run of 2^order frames
+//returns index of first frame, or BUDDY_NONE if no run is available
+uint32_t buddy_alloc(uint32_t order);
+
+//returns run of 2^order frames starting at frame to the allocator
+//frames from one run may be freed in smaller pieces
+void buddy_free(uint32_t frame, uint32_t order);
+
+//removes a specific frame from the free pool
+//returns false if frame was already in use
+bool buddy_reserve(uint32_t frame);
+
+//number of frames currently free
+uint32_t buddy_free_count();
+
+#endif
@@ -1,13 +1,37 @@
 #include "paging.h"
+#include "buddy.h"
 #include <std/kheap.h>
 #include <std/std.h>
 #include <kernel/kernel.h>
 #include <std/printf.h>
 #include <gfx/lib/gfx.h>
+#include <kernel/util/multitasking/tasks/task.h>
 
-//bitset of frames - used or free
-uint32_t* frames;
+//number of physical frames, handed out by buddy allocator
 uint32_t nframes;
+//per frame, number of extra page tables sharing the frame
+//0 means a single owner, so freeing the frame returns it to the allocator
+static uint16_t* frame_refs;
+
+static cow_stats_t cow_counters;
+
+//virtual ranges which are backed by zeroed frames on first touch
+#define MAX_VMEM_REGIONS 16
+typedef struct vmem_region {
+	uint32_t start;
+	uint32_t end;
+	uint8_t is_kernel;
+	uint8_t is_writeable;
+} vmem_region_t;
+static vmem_region_t vmem_regions[MAX_VMEM_REGIONS];
+static int vmem_region_count = 0;
+static uint32_t demand_faults = 0;
+
+//CR0 write protect bit
+//without it, supervisor writes ignore read-only pages and copy-on-write would never fault
+#define CR0_WP 0x10000
+
+extern task_t* current_task;
 
 page_directory_t* kernel_directory = 0;
 page_directory_t* current_directory = 0;
@@ -18,10 +42,6 @@ volatile uint32_t memsize = 0; //size of paging memory
 extern uint32_t placement_address;
 extern heap_t* kheap;
 
-//macros used in bitset algorithms
-#define INDEX_FROM_BIT(a) (a/(8*4))
-#define OFFSET_FROM_BIT(a) (a%(8*4))
-
 uint32_t get_cr0() {
 	uint32_t cr0;
 	asm volatile("mov %%cr0, %0" : "=r"(cr0));
@@ -48,67 +68,12 @@ void set_cr3(page_directory_t* dir) {
 	set_cr0(cr0);
 }
 
-//static function to set a bit in frames bitset
-static void set_bit_frame(uint32_t frame_addr) {
-	//if (frame_addr < nframes * 4 * 0x400) {
-		uint32_t frame = frame_addr/0x1000;
-		uint32_t idx = INDEX_FROM_BIT(frame);
-		uint32_t off = OFFSET_FROM_BIT(frame);
-		frames[idx] |= (0x1 << off);
-		/*
-	}
-	else {
-		printf_err("couldn't set frame %x", frame_addr);
-	}
-	*/
-}
-
-//static function to clear a bit in the frames bitset
-static void clear_frame(uint32_t frame_addr) {
-	uint32_t frame = frame_addr/0x1000;
-	uint32_t idx = INDEX_FROM_BIT(frame);
-	uint32_t off = OFFSET_FROM_BIT(frame);
-	frames[idx] &= ~(0x1 << off);
-}
-
-//static function to test if a bit is sset
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-function"
-static uint32_t test_frame(uint32_t frame_addr) {
-	uint32_t frame = frame_addr/0x1000;
-	uint32_t idx = INDEX_FROM_BIT(frame);
-	uint32_t off = OFFSET_FROM_BIT(frame);
-	return (frames[idx] & (0x1 << off));
-}
-#pragma GCC diagnostic pop
-
-//static function to find the first free frame
-static int32_t first_frame() {
-	for (uint32_t i = 0; i < INDEX_FROM_BIT(nframes); i++) {
-		if (frames[i] != 0xFFFFFFFF) {
-			//at least one free bit
-			for (uint32_t j = 0; j < 32; j++) {
-				uint32_t bit = 0x1 << j;
-				if (!(frames[i] & bit)) {
-					//found unused bit i in addr
-					return i*4*8+j;
-				}
-			}
-		}
-	}
-	printf_info("first_frame(): no free frames!");
-	return -1;
-}
-
 void virtual_map_pages(long addr, unsigned long size, uint32_t rw, uint32_t user) {
 	unsigned long i = addr;
 	while (i < (addr + size + 0x1000)) {
-		if (i + size < memsize) {
-			//find first free frame
-			set_bit_frame(first_frame());
-
-			//set space to taken anyway
-			kmalloc(0x1000);
+		if (i < memsize) {
+			//this page is mapped to the frame of the same address, make sure nobody else gets it
+			buddy_reserve(i / 0x1000);
 		}
 
 		page_t* page = get_page(i, 1, current_directory);
@@ -133,6 +98,11 @@ void vmem_map(uint32_t virt, uint32_t physical) {
 	printf_info("Mapping %x (%x) -> %x", virt, id, physical);
 }
 
+//drop any cached translation for the page containing addr
+static inline void invalidate_page(uint32_t addr) {
+	asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
 //function to allocate a frame
 void alloc_frame(page_t* page, int is_kernel, int is_writeable) {
 	/*
@@ -142,12 +112,10 @@ void alloc_frame(page_t* page, int is_kernel, int is_writeable) {
 		return;
 	}
 	*/
-	int32_t idx = first_frame(); //index of first free frame
-	if (idx == -1) {
+	uint32_t idx = buddy_alloc(0); //frame is now ours
+	if (idx == BUDDY_NONE) {
 		PANIC("No free frames!");
 	}
-	//printf_info("alloc_frame(): setting bit frame %x", idx);
-	set_bit_frame(idx*0x1000); //frame is now ours
 	page->present = 1; //mark as present
 	page->rw = is_writeable; //should page be writable?
 	page->user = !is_kernel; //should page be user mode?
@@ -162,18 +130,147 @@ void free_frame(page_t* page) {
 		//page didn't actually have an allocated frame!
 		return;
 	}
-	clear_frame(frame); //frame is now free again
+	if (frame_refs[frame]) {
+		//someone else still maps this frame, just drop our reference
+		frame_refs[frame]--;
+	}
+	else {
+		buddy_free(frame, 0); //frame is now free again
+	}
 	page->frame = 0x0; //page now doesn't have a frame
 }
 
-#define VESA_WIDTH 1024
-#define VESA_HEIGHT 768
+//maps count pages starting at virt, backed by physically contiguous runs of frames
+//uses the largest runs available so big mappings don't fragment the frame pool
+void alloc_frames(uint32_t virt, uint32_t count, page_directory_t* dir, int is_kernel, int is_writeable) {
+	while (count) {
+		//largest power of two run which doesn't overshoot count
+		uint32_t order = 31 - __builtin_clz(count);
+		if (order > BUDDY_MAX_ORDER) order = BUDDY_MAX_ORDER;
+
+		uint32_t frame = buddy_alloc(order);
+		//memory may be too fragmented for a run this big, fall back to smaller ones
+		while (frame == BUDDY_NONE && order > 0) {
+			frame = buddy_alloc(--order);
+		}
+		if (frame == BUDDY_NONE) {
+			PANIC("No free frames!");
+		}
+
+		for (uint32_t i = 0; i < (1u << order); i++) {
+			page_t* page = get_page(virt, 1, dir);
+			page->present = 1;
+			page->rw = is_writeable;
+			page->user = !is_kernel;
+			page->frame = frame + i;
+			virt += 0x1000;
+		}
+		count -= 1 << order;
+	}
+}
+
+void vmem_reserve(uint32_t start, uint32_t size, int is_kernel, int is_writeable) {
+	ASSERT(start % 0x1000 == 0 && size % 0x1000 == 0, "vmem_reserve(): %x + %x isn't page aligned", start, size);
+	uint32_t end = start + size;
+
+	//faults are resolved against whichever directory is active, so the tables must be shared by all of them
+	for (uint32_t addr = start; addr < end; addr += 0x1000 * 1024) {
+		ASSERT(kernel_directory->tables[addr / 0x1000 / 1024], "vmem_reserve(): %x isn't covered by a kernel page table", addr);
+	}
+
+	//grow an adjacent region with the same permissions if there is one
+	for (int i = 0; i < vmem_region_count; i++) {
+		vmem_region_t* region = &vmem_regions[i];
+		if (region->is_kernel != is_kernel || region->is_writeable != is_writeable) continue;
+
+		if (region->end == start) {
+			region->end = end;
+			return;
+		}
+		if (region->start == end) {
+			region->start = start;
+			return;
+		}
+	}
+
+	if (vmem_region_count >= MAX_VMEM_REGIONS) {
+		PANIC("vmem_reserve(): too many regions");
+	}
+	vmem_region_t* region = &vmem_regions[vmem_region_count++];
+	region->start = start;
+	region->end = end;
+	region->is_kernel = is_kernel;
+	region->is_writeable = is_writeable;
+}
+
+void vmem_release(uint32_t start, uint32_t size) {
+	uint32_t end = start + size;
+
+	//give back every frame which was faulted in
+	for (uint32_t addr = start; addr < end; addr += 0x1000) {
+		page_t* page = get_page(addr, 0, kernel_directory);
+		if (!page || !page->present) continue;
+
+		free_frame(page);
+		page->present = 0;
+		invalidate_page(addr);
+	}
+
+	//cut range out of any region it overlaps
+	for (int i = 0; i < vmem_region_count; i++) {
+		vmem_region_t* region = &vmem_regions[i];
+		if (end <= region->start || start >= region->end) continue;
+
+		if (start <= region->start && end >= region->end) {
+			//whole region released, fill its slot with the last region
+			*region = vmem_regions[--vmem_region_count];
+			i--;
+		}
+		else if (start <= region->start) {
+			region->start = end;
+		}
+		else if (end >= region->end) {
+			region->end = start;
+		}
+		else {
+			//released range is in the middle, split region in two
+			if (vmem_region_count >= MAX_VMEM_REGIONS) {
+				PANIC("vmem_release(): too many regions");
+			}
+			vmem_region_t* upper = &vmem_regions[vmem_region_count++];
+			*upper = *region;
+			upper->start = end;
+			region->end = start;
+		}
+	}
+}
+
+//allocates 2^order physically contiguous frames, ie for DMA buffers
+//returns physical address of first frame, or 0 if no run that large is free
+uint32_t alloc_contiguous(uint32_t order) {
+	uint32_t frame = buddy_alloc(order);
+	if (frame == BUDDY_NONE) return 0;
+	return frame * 0x1000;
+}
+
+//returns run allocated with alloc_contiguous
+void free_contiguous(uint32_t phys, uint32_t order) {
+	buddy_free(phys / 0x1000, order);
+}
+
+//VESA LFB window mapped at boot, before any mode is set
+//16MB is all of QEMU and Bochs' video memory, room for two pages of any mode vesa_pick_mode chooses
+#define VESA_LFB_SIZE (16 * 1024 * 1024)
+static uint32_t lfb_start;
+static uint32_t lfb_size;
+
 void identity_map_lfb(uint32_t location) { uint32_t j = location;
-	//TODO use screen object instead of these vals
-	while (j < location + (VESA_WIDTH * VESA_HEIGHT * 4)) {
-		//if frame is valid
-		if (j + location + (VESA_WIDTH * VESA_HEIGHT * 4) < memsize) {
-			set_bit_frame(j); //tell frame bitset this frame is in use
+	lfb_start = location;
+	lfb_size = VESA_LFB_SIZE;
+	while (j < location + VESA_LFB_SIZE) {
+		//if frame is backed by RAM, make sure it's never handed out
+		if (j / 0x1000 < nframes) {
+			buddy_reserve(j / 0x1000);
 		}
 		//get page
 		page_t* page = get_page(j, 1, kernel_directory);
@@ -186,12 +283,16 @@ void identity_map_lfb(uint32_t location) { uint32_t j = location;
 	}
 }
 
+bool lfb_mapped(uint32_t start, uint32_t size) {
+	return start >= lfb_start && start + size <= lfb_start + lfb_size && start + size >= start;
+}
+
 static void page_fault(registers_t regs);
 
 void set_paging_bit(bool enabled) {
 	kernel_begin_critical();
 	if (enabled) {
-		set_cr0(get_cr0() | 0x80000000);
+		set_cr0(get_cr0() | 0x80000000 | CR0_WP);
 	}
 	else {
 		set_cr0(get_cr0() & 0x80000000);
@@ -209,8 +310,9 @@ void paging_install() {
 	memsize = mem_end_page;
 
 	nframes = mem_end_page / 0x1000;
-	frames = (uint32_t*)kmalloc(INDEX_FROM_BIT(nframes));
-	memset(frames, 0, INDEX_FROM_BIT(nframes));
+	buddy_init(nframes);
+	frame_refs = (uint16_t*)kmalloc(nframes * sizeof(uint16_t));
+	memset(frame_refs, 0, nframes * sizeof(uint16_t));
 
 	//make page directory
 	// uint32_t phys;
@@ -228,7 +330,10 @@ void paging_install() {
 	//don't alloc the frames yet, they need to be identity
 	//mapped below first.
     unsigned int i = 0;
-	for (i = KHEAP_START; i < KHEAP_START + KHEAP_INITIAL_SIZE; i += 0x1000) {
+	//create page tables for the entire heap range up front, not just the initial size
+	//this way expand() never has to allocate a page table from the heap it's growing,
+	//and every cloned directory links the same heap tables
+	for (i = KHEAP_START; i < KHEAP_MAX_ADDRESS; i += 0x1000) {
 		get_page(i, 1, kernel_directory);
 	}
 
@@ -240,15 +345,17 @@ void paging_install() {
 	//on-the-fly instead of once at the start
 	unsigned idx = 0;
 	while (idx < placement_address + 0x1000) {
-		//kernel code is readable but not writeable from userspace
-		alloc_frame(get_page(idx, 1, kernel_directory), 0, 0);
+		//write protect is enabled, so the kernel's own data must be mapped writeable
+		page_t* page = get_page(idx, 1, kernel_directory);
+		buddy_reserve(idx / 0x1000);
+		page->present = 1;
+		page->rw = 1;
+		page->user = 1;
+		page->frame = idx / 0x1000;
 		idx += 0x1000;
 	}
 
-	//allocate pages we mapped earlier
-	for (i = KHEAP_START; i < KHEAP_START + KHEAP_INITIAL_SIZE; i += 0x1000) {
-		alloc_frame(get_page(i, 1, kernel_directory), 0, 0);
-	}
+	//heap pages are backed on first touch by the page fault handler, so nothing to allocate yet
 	printf_info("finished identity mapping kernel pages");
 
 	//before we enable paging, register page fault handler
@@ -262,7 +369,6 @@ void paging_install() {
 
 	//initialize kernel heap
 	kheap = create_heap(KHEAP_START, KHEAP_START + KHEAP_INITIAL_SIZE, KHEAP_MAX_ADDRESS, 0, 0);
-	expand(0x1000000, kheap);
 
 	current_directory = clone_directory(kernel_directory);
 	switch_page_directory(current_directory);
@@ -294,14 +400,94 @@ page_t* get_page(uint32_t address, int make, page_directory_t* dir) {
 	return 0;
 }
 
-static void page_fault(registers_t regs) {
-	switch_to_text();
+extern void copy_page_physical(uint32_t page, uint32_t dest);
+
+//gives the current address space a private, writeable copy of a copy-on-write page
+//returns false if addr isn't a copy-on-write page
+static bool cow_fault(uint32_t addr) {
+	page_t* page = get_page(addr, 0, current_directory);
+	if (!page || !page->cow) return false;
+
+	uint32_t frame = page->frame;
+	if (frame_refs[frame]) {
+		//frame is still shared, copy it
+		uint32_t copy = buddy_alloc(0);
+		if (copy == BUDDY_NONE) {
+			PANIC("No free frames!");
+		}
+		copy_page_physical(frame * 0x1000, copy * 0x1000);
+		frame_refs[frame]--;
+		page->frame = copy;
+		cow_counters.pages_copied++;
+	}
+	//otherwise everyone else already took a copy, and this frame is ours alone
+
+	page->cow = 0;
+	page->rw = 1;
+	invalidate_page(addr);
+
+	cow_counters.write_faults++;
+	return true;
+}
+
+//backs a page in a reserved region with a zeroed frame
+//returns false if addr isn't in a reserved region
+static bool demand_fault(uint32_t addr) {
+	vmem_region_t* region = NULL;
+	for (int i = 0; i < vmem_region_count; i++) {
+		if (addr >= vmem_regions[i].start && addr < vmem_regions[i].end) {
+			region = &vmem_regions[i];
+			break;
+		}
+	}
+	if (!region) return false;
+
+	page_t* page = get_page(addr, 0, current_directory);
+	if (!page) return false;
+
+	uint32_t frame = buddy_alloc(0);
+	if (frame == BUDDY_NONE) {
+		PANIC("No free frames!");
+	}
+
+	//map writeable long enough to clear out whatever the last owner left behind
+	uint32_t base = addr & ~0xFFF;
+	page->present = 1;
+	page->rw = 1;
+	page->user = !region->is_kernel;
+	page->frame = frame;
+	invalidate_page(base);
+	memset((void*)base, 0, 0x1000);
+
+	if (!region->is_writeable) {
+		page->rw = 0;
+		invalidate_page(base);
+	}
+
+	demand_faults++;
+	if (current_task) {
+		current_task->page_faults++;
+	}
+	return true;
+}
 
+static void page_fault(registers_t regs) {
 	//page fault has occured
 	//faulting address is stored in CR2 register
 	uint32_t faulting_address;
 	asm volatile("mov %%cr2, %0" : "=r" (faulting_address));
 
+	//write to a present page may just be a copy-on-write page being touched
+	if ((regs.err_code & 0x1) && (regs.err_code & 0x2)) {
+		if (cow_fault(faulting_address)) return;
+	}
+	//first touch of a reserved page
+	if (!(regs.err_code & 0x1)) {
+		if (demand_fault(faulting_address)) return;
+	}
+
+	switch_to_text();
+
 	//error code tells us what happened
 	int present = !(regs.err_code & 0x1); //page not present
 	int rw = regs.err_code & 0x2; //write operation?
@@ -331,31 +517,11 @@ static void page_fault(registers_t regs) {
 		printf_err("Page fault caused by reading unpaged memory");
 	}
 
-	//if this page was present, attempt to recover by allocating the page
-	if (present) {
-		printf_info("attempting page fault recovery...");
-		//upper 10 bits of faulting addr has pde
-		unsigned table_mask = (1 << 10) - 1;
-		page_table_t* table = (page_table_t*)(faulting_address & table_mask);
-		printf_info("Addr of table: %x", &table);
-
-		//middle 10 bits has pte
-		unsigned page_mask = ((1 << 10) - 1) << 10;
-		page_t* page = (page_t*)(faulting_address & page_mask);
-		printf_info("page addr %x", &page);
-		printf_info("page frame: %x", page->frame);
-		alloc_frame(get_page((uint32_t)&page, present, kernel_directory), 0, rw);
-
-		asm volatile("xchgw %bx, %bx");
-
-		//return;
-	}
-
 	extern void common_halt(registers_t regs, bool recoverable);
 	common_halt(regs, false);
 }
 
-static page_table_t* clone_table(page_table_t* src, uint32_t* physAddr) {
+static page_table_t* clone_table(page_table_t* src, uint32_t* physAddr, bool eager) {
 	//make new page aligned table
 	page_table_t* table = (page_table_t*)kmalloc_ap(sizeof(page_table_t), physAddr);
 	//ensure new table is blank
@@ -366,33 +532,52 @@ static page_table_t* clone_table(page_table_t* src, uint32_t* physAddr) {
 		//if source entry has a frame associated with it
 		if (!src->pages[i].frame) continue;
 
+		if (!eager) {
+			//share frame, and make both sides copy it on their first write
+			if (src->pages[i].rw) {
+				src->pages[i].rw = 0;
+				src->pages[i].cow = 1;
+			}
+			table->pages[i] = src->pages[i];
+			frame_refs[src->pages[i].frame]++;
+			cow_counters.pages_shared++;
+			continue;
+		}
+
 		//get new frame
 		alloc_frame(&table->pages[i], 0, 0);
 		//clone flags from source to destination
 		table->pages[i].present = src->pages[i].present;
-		table->pages[i].rw = src->pages[i].rw;
+		//a shared copy-on-write page is writable once it has a frame of its own, which this copy is
+		table->pages[i].rw = src->pages[i].rw || src->pages[i].cow;
 		table->pages[i].user = src->pages[i].user;
 		table->pages[i].accessed = src->pages[i].accessed;
 		table->pages[i].dirty = src->pages[i].dirty;
 
 		//physically copy data across
-		extern void copy_page_physical(uint32_t page, uint32_t dest);
 		copy_page_physical(src->pages[i].frame * 0x1000, table->pages[i].frame * 0x1000);
+		cow_counters.pages_copied++;
 	}
 	return table;
 }
 
 page_directory_t* clone_directory(page_directory_t* src) {
-	uint32_t phys;
-
-	//make new page directory and get physaddr
-	page_directory_t* dir = (page_directory_t*)kmalloc_ap(sizeof(page_directory_t), &phys);
+	//make new page directory
+	page_directory_t* dir = (page_directory_t*)kmalloc_a(sizeof(page_directory_t));
 	//blank it
+	//this also faults in every page of the directory
 	memset((uint8_t*)dir, 0, sizeof(page_directory_t));
 
-	//get offset of tablesPhysical from start of page_directory_t
-	uint32_t offset = (uint32_t)dir->tablesPhysical - (uint32_t)dir;
-	dir->physicalAddr = phys + offset;
+	//heap pages are backed one at a time, so tablesPhysical isn't necessarily
+	//physically contiguous with the start of the directory. look up its frame
+	page_t* tables_page = get_page((uint32_t)dir->tablesPhysical, 0, current_directory);
+	dir->physicalAddr = tables_page->frame * 0x1000 + ((uint32_t)dir->tablesPhysical & 0xFFF);
+
+	//the page fault handler runs on the current stack, so a copy-on-write stack could never fault
+	//copy the table holding the stack up front instead
+	uint32_t esp;
+	asm volatile("mov %%esp, %0" : "=r"(esp));
+	uint32_t stack_table = esp / 0x1000 / 1024;
 
 	//for each page table
 	//if in kernel directory, don't make copy
@@ -407,17 +592,33 @@ page_directory_t* clone_directory(page_directory_t* src) {
 		else {
 			//copy table
 			uint32_t phys;
-			dir->tables[i] = clone_table(src->tables[i], &phys);
+			dir->tables[i] = clone_table(src->tables[i], &phys, src == current_directory && i == (int)stack_table);
 			dir->tablesPhysical[i] = phys | 0x07;
 		}
 	}
+
+	//source pages may have just become read-only, flush stale writeable entries from TLB
+	if (src == current_directory) {
+		set_cr3(current_directory);
+	}
 	return dir;
 }
 
+cow_stats_t cow_stats() {
+	return cow_counters;
+}
+
+uint32_t demand_fault_count() {
+	return demand_faults;
+}
+
 void free_directory(page_directory_t* dir) {
 	//first free all tables
 	for (int i = 0; i < 1024; i++) {
 		page_table_t* table = dir->tables[i];
+		//kernel tables are linked into every directory, so they aren't ours to free
+		if (!table || table == kernel_directory->tables[i]) continue;
+
 		//free all pages in table
 		for (int j = 0; j < 1024; j++) {
 			page_t page = table->pages[j];
@@ -3,6 +3,7 @@
 
 #include <std/common.h>
 #include <kernel/util/interrupts/isr.h>
+#include <stdbool.h>
 
 typedef struct page {
 	uint32_t present	:  1; //page present in memory
@@ -10,7 +11,9 @@ typedef struct page {
 	uint32_t user 		:  1; //kernel level only if clear
 	uint32_t accessed	:  1; //has page been accessed since last refresh?
 	uint32_t dirty		:  1; //has page been written to since last refresh?
-	uint32_t unused		:  7; //unused/reserved bits
+	uint32_t unused		:  4; //unused/reserved bits
+	uint32_t cow		:  1; //frame is shared copy-on-write, copy before allowing writes
+	uint32_t avail		:  2; //free for kernel use
 	uint32_t frame		: 20; //frame address, shifted right 12 bits
 } page_t;
 
@@ -54,9 +57,39 @@ void vmem_map(uint32_t virt, uint32_t physical);
 void alloc_frame(page_t* page, int is_kernel, int is_writeable);
 void free_frame(page_t* page);
 
+//maps count pages starting at virt in dir, backed by physically contiguous runs of frames
+void alloc_frames(uint32_t virt, uint32_t count, page_directory_t* dir, int is_kernel, int is_writeable);
+
+//reserves [start, start + size) to be backed by zeroed frames on first touch
+//range must be page aligned and lie within page tables linked from kernel_directory
+void vmem_reserve(uint32_t start, uint32_t size, int is_kernel, int is_writeable);
+//frees any frames backing [start, start + size) and stops backing the range on demand
+void vmem_release(uint32_t start, uint32_t size);
+//number of pages backed on demand since boot
+uint32_t demand_fault_count();
+
+//allocates 2^order physically contiguous frames
+//returns physical address of first frame, or 0 if no run that large is free
+uint32_t alloc_contiguous(uint32_t order);
+//returns run allocated with alloc_contiguous
+void free_contiguous(uint32_t phys, uint32_t order);
+
+//true if [start, start + size) lies inside the linear framebuffer window identity mapped at boot
+bool lfb_mapped(uint32_t start, uint32_t size);
+
+//copy-on-write counters since boot
+typedef struct cow_stats {
+	uint32_t pages_shared; //pages mapped into a clone without copying
+	uint32_t pages_copied; //pages physically copied, either eagerly or on a write fault
+	uint32_t write_faults; //write faults resolved on copy-on-write pages
+} cow_stats_t;
+
 //create a new page directory with all the info of src
-//kernel pages are linked instead of copied
+//kernel pages are linked, other pages are shared copy-on-write
 page_directory_t* clone_directory(page_directory_t* src);
+
+//returns copy-on-write counters
+cow_stats_t cow_stats();
 //free all memory associated with a page directory dir
 void free_directory(page_directory_t* dir);
 
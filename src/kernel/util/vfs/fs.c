@@ -1,5 +1,6 @@
 #include "fs.h"
 #include <std/std.h>
+#include <std/math.h>
 
 fs_node_t* fs_root = 0; //filesystem root
 
@@ -52,49 +53,248 @@ fs_node_t* finddir_fs(fs_node_t* node, char* name) {
 	return 0;
 }
 
+fs_node_t* lookup_fs(fs_node_t* dir, char* path) {
+	//absolute paths start from the root
+	if (*path == '/') {
+		dir = fs_root;
+	}
+
+	char component[128];
+	while (dir && *path) {
+		//skip separators
+		if (*path == '/') {
+			path++;
+			continue;
+		}
+
+		uint32_t len = 0;
+		while (path[len] && path[len] != '/') len++;
+		if (len >= sizeof(component)) return 0;
+		memcpy(component, path, len);
+		component[len] = '\0';
+		path += len;
+
+		if (!strcmp(component, "..")) {
+			//root is its own parent
+			if (dir->parent) dir = dir->parent;
+		}
+		else if (strcmp(component, ".")) {
+			dir = finddir_fs(dir, component);
+		}
+	}
+	return dir;
+}
+
+uint8_t* map_fs(fs_node_t* node) {
+	//does the node have a map callback?
+	if ((node->flags & 0x7) == FS_FILE && node->map) {
+		return node->map(node);
+	}
+	return 0;
+}
+
+FILE* fopen_node(fs_node_t* node) {
+	FILE* stream = (FILE*)kmalloc(sizeof(FILE));
+	memset(stream, 0, sizeof(FILE));
+	stream->node = node;
+	stream->fpos = 0;
+
+	//read-only files already in memory are streamed straight from there
+	uint8_t* mapped = node->write ? NULL : map_fs(node);
+	if (mapped) {
+		stream->buf = mapped;
+		stream->buf_size = node->length;
+		stream->buf_len = node->length;
+		stream->buf_mapped = true;
+		return stream;
+	}
+
+	//size buffer to the file so small files are read with a single call
+	stream->buf_size = FILE_BUFFER_SIZE;
+	if (node->length && node->length < FILE_BUFFER_SIZE) {
+		stream->buf_size = node->length;
+	}
+	stream->buf = kmalloc(stream->buf_size);
+	return stream;
+}
+
+uint8_t* load_fs(fs_node_t* node, bool* copied) {
+	uint8_t* data = map_fs(node);
+	*copied = (data == NULL);
+	if (data) return data;
+
+	data = kmalloc(node->length);
+	if (read_fs(node, 0, node->length, data) != node->length) {
+		kfree(data);
+		return NULL;
+	}
+	return data;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 FILE* fopen(char* filename, char* mode) {
-	fs_node_t* file = finddir_fs(fs_root, filename);
+	fs_node_t* file = lookup_fs(fs_root, filename);
 	if (!file) {
 		printf_err("Couldn't find file %s", filename);
 		return NULL;
 	}
-	FILE* stream = (FILE*)kmalloc(sizeof(FILE));
-	memset(stream, 0, sizeof(FILE));
-	stream->node = file;
-	stream->fpos = 0;
-	return stream;
+	return fopen_node(file);
 }
 #pragma GCC diagnostic pop
 
-uint8_t fgetc(FILE* stream) {
-	uint8_t ch;
-	uint32_t sz = read_fs(stream->node, stream->fpos++, 1, &ch);
-	if ((int8_t)ch == EOF || !sz) return EOF;
-	return ch;
+int fflush(FILE* stream) {
+	if (!stream->buf_dirty) return 0;
+
+	uint32_t len = stream->buf_len;
+	uint32_t written = write_fs(stream->node, stream->buf_start, len, stream->buf);
+	stream->buf_dirty = false;
+	stream->buf_len = 0;
+	return written == len ? 0 : EOF;
+}
+
+int fclose(FILE* stream) {
+	if (!stream) return EOF;
+
+	int ret = fflush(stream);
+	if (!stream->buf_mapped) {
+		kfree(stream->buf);
+	}
+	kfree(stream);
+	return ret;
+}
+
+//number of bytes in buf at or after fpos
+static inline uint32_t stream_buffered(FILE* stream) {
+	if (stream->buf_dirty) return 0;
+	if (stream->fpos < stream->buf_start || stream->fpos >= stream->buf_start + stream->buf_len) return 0;
+	return stream->buf_start + stream->buf_len - stream->fpos;
+}
+
+//read ahead a block starting at fpos
+//returns number of bytes now available
+static uint32_t stream_fill(FILE* stream) {
+	uint32_t available = stream_buffered(stream);
+	if (available || stream->buf_mapped) {
+		if (!available) stream->eof = true;
+		return available;
+	}
+
+	fflush(stream);
+	stream->buf_start = stream->fpos;
+	stream->buf_len = read_fs(stream->node, stream->fpos, stream->buf_size, stream->buf);
+	if (!stream->buf_len) stream->eof = true;
+	return stream->buf_len;
+}
+
+int fgetc(FILE* stream) {
+	if (!stream_fill(stream)) return EOF;
+	return stream->buf[stream->fpos++ - stream->buf_start];
 }
 
 char* fgets(char* buf, int count, FILE* stream) {
-	int c;
 	char* cs = buf;
-	while (--count > 0 && (c = fgetc(stream)) != EOF) {
-		//place input char in current position, then increment
-		//quit on newline
-		if ((*cs++ = c) == '\n') break;
+	//leave room for null terminator
+	count--;
+	while (count > 0) {
+		uint32_t available = stream_fill(stream);
+		if (!available) break;
+
+		//copy up to and including the next newline straight out of the buffer
+		uint8_t* src = stream->buf + (stream->fpos - stream->buf_start);
+		uint32_t len = MIN(available, (uint32_t)count);
+		uint32_t i = 0;
+		while (i < len && src[i++] != '\n') {}
+
+		memcpy(cs, src, i);
+		cs += i;
+		count -= i;
+		stream->fpos += i;
+		if (cs[-1] == '\n') break;
 	}
 	*cs = '\0';
-	return (c == EOF && cs == buf) ? (char*)EOF : buf;
+	return cs == buf ? NULL : buf;
 }
 
 uint32_t fread(void* buffer, uint32_t size, uint32_t count, FILE* stream) {
-	unsigned char* chbuf = (unsigned char*)buffer;
-	uint32_t sum;
-	for (uint32_t i = 0; i < count; i++) {
-		unsigned char buf;
-		sum += read_fs(stream->node, stream->fpos++, size, (uint8_t*)&buf);
-		//TODO check for eof and break early
-		chbuf[i] = buf;
-	}
-	return sum;
+	if (!size) return 0;
+
+	uint8_t* dest = (uint8_t*)buffer;
+	uint32_t remaining = size * count;
+	while (remaining) {
+		uint32_t available = stream_buffered(stream);
+		if (!available && remaining >= stream->buf_size && !stream->buf_mapped) {
+			//request is bigger than a read-ahead block, so skip the buffer and read straight into the caller's memory
+			fflush(stream);
+			uint32_t read = read_fs(stream->node, stream->fpos, remaining, dest);
+			stream->fpos += read;
+			dest += read;
+			remaining -= read;
+			if (!read) stream->eof = true;
+			break;
+		}
+
+		available = stream_fill(stream);
+		if (!available) break;
+
+		uint32_t chunk = MIN(available, remaining);
+		memcpy(dest, stream->buf + (stream->fpos - stream->buf_start), chunk);
+		stream->fpos += chunk;
+		dest += chunk;
+		remaining -= chunk;
+	}
+	return ((size * count) - remaining) / size;
+}
+
+uint32_t fwrite(const void* buffer, uint32_t size, uint32_t count, FILE* stream) {
+	if (!size || stream->buf_mapped) return 0;
+
+	const uint8_t* src = (const uint8_t*)buffer;
+	uint32_t remaining = size * count;
+	while (remaining) {
+		//start a new run of writes if the buffer holds read-ahead, or the writes aren't contiguous
+		if (!stream->buf_dirty || stream->fpos != stream->buf_start + stream->buf_len) {
+			if (fflush(stream)) break;
+			stream->buf_start = stream->fpos;
+			stream->buf_len = 0;
+		}
+		//buffer is full, pass it on
+		if (stream->buf_len == stream->buf_size) {
+			if (fflush(stream)) break;
+			stream->buf_start = stream->fpos;
+		}
+
+		uint32_t chunk = MIN(stream->buf_size - stream->buf_len, remaining);
+		memcpy(stream->buf + stream->buf_len, src, chunk);
+		stream->buf_len += chunk;
+		stream->buf_dirty = true;
+		stream->fpos += chunk;
+		src += chunk;
+		remaining -= chunk;
+	}
+	return ((size * count) - remaining) / size;
+}
+
+int fseek(FILE* stream, int32_t offset, int whence) {
+	int32_t base = 0;
+	if (whence == SEEK_CUR) base = stream->fpos;
+	else if (whence == SEEK_END) base = stream->node->length;
+	else if (whence != SEEK_SET) return EOF;
+
+	if (base + offset < 0) return EOF;
+
+	//pending writes belong at the old position
+	if (fflush(stream)) return EOF;
+	//read-ahead stays valid, the next read uses it if the new position falls inside it
+	stream->fpos = base + offset;
+	stream->eof = false;
+	return 0;
+}
+
+uint32_t ftell(FILE* stream) {
+	return stream->fpos;
+}
+
+int feof(FILE* stream) {
+	return stream->eof;
 }
@@ -2,6 +2,7 @@
 #define FS_H
 
 #include <std/common.h>
+#include <stdbool.h>
 
 #define FS_FILE		0x01
 #define FS_DIRECTORY	0x02
@@ -21,6 +22,7 @@ typedef void (*open_type_t)(struct fs_node*);
 typedef void (*close_type_t)(struct fs_node*);
 typedef struct dirent * (*readdir_type_t)(struct fs_node*, uint32_t);
 typedef struct fs_node * (*finddir_type_t)(struct fs_node*, char* name);
+typedef uint8_t* (*map_type_t)(struct fs_node*);
 
 typedef struct fs_node {
 	char name[128]; 	//filename
@@ -37,13 +39,30 @@ typedef struct fs_node {
 	close_type_t close;
 	readdir_type_t readdir;
 	finddir_type_t finddir;
+	map_type_t map;		//returns file contents directly if the fs keeps them in memory
 	struct fs_node* ptr;	//used by mountpoints and symlinks
 	struct fs_node* parent; //parent directory of this node
 } fs_node_t;
 
+//buffer size for streams over files which can't be mapped
+//files smaller than this get a buffer just big enough to hold them
+#define FILE_BUFFER_SIZE	4096
+
+#define SEEK_SET	0
+#define SEEK_CUR	1
+#define SEEK_END	2
+
 typedef struct file_t {
-	uint32_t fpos;
+	uint32_t fpos;		//stream position seen by the caller
 	fs_node_t* node;
+
+	uint8_t* buf;		//read-ahead, or pending writes if dirty
+	uint32_t buf_size;	//capacity of buf
+	uint32_t buf_start;	//file offset of buf[0]
+	uint32_t buf_len;	//valid bytes in buf
+	bool buf_dirty;		//buf holds writes which haven't reached the node
+	bool buf_mapped;	//buf is the node's own memory, which is never refilled or freed
+	bool eof;		//a read hit the end of the file
 } FILE;
 
 struct dirent {
@@ -62,9 +81,34 @@ void open_fs(fs_node_t* node, uint8_t read, uint8_t write);
 void close_fs(fs_node_t* node);
 struct dirent* readdir_fs(fs_node_t* node, uint32_t index);
 fs_node_t* finddir_fs(fs_node_t* node, char* name);
+//follows a '/' separated path from dir, or from the root if path starts with '/'
+//understands "." and ".."
+fs_node_t* lookup_fs(fs_node_t* dir, char* path);
+//returns pointer to node's contents if its filesystem keeps them in memory, NULL otherwise
+//contents are read-only and stay valid for the life of the filesystem
+uint8_t* map_fs(fs_node_t* node);
+//returns node's whole contents, mapped if possible, otherwise read into a new buffer in one call
+//*copied is set if the contents were read, and the caller must kfree them
+uint8_t* load_fs(fs_node_t* node, bool* copied);
 
+//buffered streams over fs nodes
+//mode is currently ignored, every stream can be read and written
 FILE* fopen(char* filename, char* mode);
-uint8_t fgetc(FILE* stream);
+//stream over an already looked up node
+FILE* fopen_node(fs_node_t* node);
+//flushes and frees stream
+int fclose(FILE* stream);
+//passes any buffered writes on to the node
+int fflush(FILE* stream);
+
+int fgetc(FILE* stream);
+char* fgets(char* buf, int count, FILE* stream);
+//return number of whole items transferred
 uint32_t fread(void* buffer, uint32_t size, uint32_t count, FILE* stream);
+uint32_t fwrite(const void* buffer, uint32_t size, uint32_t count, FILE* stream);
+
+int fseek(FILE* stream, int32_t offset, int whence);
+uint32_t ftell(FILE* stream);
+int feof(FILE* stream);
 
 #endif
@@ -1,117 +1,276 @@
 #include "initrd.h"
+#include "lz4.h"
 #include <std/std.h>
+#include <std/math.h>
+#include <kernel/util/mutex/mutex.h>
+
+//decoded blocks of compressed files kept around for reads that only want part of one
+#define INITRD_CACHE_BLOCKS 8
+
+static uint32_t initrd_base;		//address image was loaded at
+static initrd_header_t* initrd_header;	//header
+static initrd_entry_t* entries;		//every file and directory, root first
+static uint32_t* buckets;		//open addressed name index into entries
+static const char* names;		//string table entry names point into
+static fs_node_t** nodes;		//fs node of each entry, built the first time it's looked up
+
+typedef struct {
+	uint32_t entry;		//INITRD_BUCKET_EMPTY if the slot holds nothing
+	uint32_t block;
+	uint32_t last_used;
+	uint8_t* data;		//allocated the first time the slot is used
+} initrd_cache_slot;
+
+static initrd_cache_slot block_cache[INITRD_CACHE_BLOCKS];
+static uint32_t cache_clock;
+static lock_t* cache_lock;
+static initrd_stats_t stats;
 
-initrd_header_t* initrd_header;		//header
-initrd_file_header_t* file_headers;	//list of file headers
 fs_node_t* initrd_root;			//root directory node
 fs_node_t* initrd_dev;			//add directory node for /dev so we can mount devfs later on
-fs_node_t* root_nodes;			//list of file nodes
-uint8_t nroot_nodes;			//number of file nodes
 
 struct dirent dirent;
 
+static fs_node_t* initrd_node(uint32_t index);
+
+//decoded size of block of entry
+static inline uint32_t block_length(initrd_entry_t* entry, uint32_t block) {
+	return MIN(initrd_header->block_size, entry->length - (block * initrd_header->block_size));
+}
+
+static void decode_block(initrd_entry_t* entry, uint32_t block, uint8_t* dest) {
+	uint32_t* block_offsets = (uint32_t*)(initrd_base + entry->offset);
+	uint8_t* src = (uint8_t*)(initrd_base + entry->offset + block_offsets[block]);
+	uint32_t stored = block_offsets[block + 1] - block_offsets[block];
+	uint32_t len = block_length(entry, block);
+
+	if (stored == len) {
+		//block didn't compress
+		memcpy(dest, src, len);
+	}
+	else {
+		int decoded = lz4_decompress(src, stored, dest, len);
+		ASSERT(decoded == (int)len, "initrd: block %d of entry %d is corrupt", block, entry - entries);
+	}
+	stats.blocks_decoded++;
+	stats.bytes_decoded += len;
+}
+
+//copy part of a block out of the cache, decoding it into the least recently used slot if it isn't there
+static void read_cached(initrd_entry_t* entry, uint32_t block, uint32_t from, uint32_t len, uint8_t* dest) {
+	uint32_t index = entry - entries;
+
+	lock(cache_lock);
+	initrd_cache_slot* slot = &block_cache[0];
+	bool hit = false;
+	for (int i = 0; i < INITRD_CACHE_BLOCKS; i++) {
+		initrd_cache_slot* candidate = &block_cache[i];
+		if (candidate->entry == index && candidate->block == block) {
+			slot = candidate;
+			hit = true;
+			break;
+		}
+		if (candidate->last_used < slot->last_used) {
+			slot = candidate;
+		}
+	}
+
+	if (hit) {
+		stats.cache_hits++;
+	}
+	else {
+		stats.cache_misses++;
+		if (!slot->data) {
+			slot->data = kmalloc(initrd_header->block_size);
+		}
+		decode_block(entry, block, slot->data);
+		slot->entry = index;
+		slot->block = block;
+	}
+	slot->last_used = ++cache_clock;
+
+	memcpy(dest, slot->data + from, len);
+	unlock(cache_lock);
+}
+
 static uint32_t initrd_read(fs_node_t* node, uint32_t offset, uint32_t size, uint8_t* buffer) {
-	initrd_file_header_t header = file_headers[node->inode];
-	if (offset >= header.length) {
+	initrd_entry_t* entry = &entries[node->inode];
+	if (offset >= entry->length) {
 		*buffer = EOF;
 		return 0;
 	}
-	if (offset + size > header.length) {
-		size = header.length - offset;
+	if (offset + size > entry->length) {
+		size = entry->length - offset;
+	}
+
+	if (!(entry->flags & INITRD_ENTRY_COMPRESSED)) {
+		memcpy(buffer, (uint8_t*)(initrd_base + entry->offset + offset), size);
+		return size;
+	}
+
+	uint32_t block_size = initrd_header->block_size;
+	uint32_t done = 0;
+	while (done < size) {
+		uint32_t pos = offset + done;
+		uint32_t block = pos / block_size;
+		uint32_t from = pos % block_size;
+		uint32_t len = MIN(block_length(entry, block) - from, size - done);
+
+		if (!from && len == block_length(entry, block)) {
+			//caller wants the whole block, so decode straight into their buffer
+			decode_block(entry, block, buffer + done);
+		}
+		else {
+			read_cached(entry, block, from, len, buffer + done);
+		}
+		done += len;
 	}
-	memcpy(buffer, (uint8_t*)(header.offset + offset), size);
 	return size;
 }
 
+static uint8_t* initrd_map(fs_node_t* node) {
+	//compressed files only exist in memory a block at a time
+	initrd_entry_t* entry = &entries[node->inode];
+	if (entry->flags & INITRD_ENTRY_COMPRESSED) return 0;
+
+	//ramdisk is already in memory, so files can be handed out in place
+	return (uint8_t*)(initrd_base + entry->offset);
+}
+
 static struct dirent* initrd_readdir(fs_node_t* node, uint32_t index) {
-	if (node == initrd_root && index == 0) {
-		strcpy(dirent.name, "dev");
-		dirent.name[3] = 0; //null terminate string
-		dirent.ino = 0;
-		return &dirent;
+	//nothing is mounted on /dev yet
+	if (node == initrd_dev) return 0;
+
+	if (node == initrd_root) {
+		if (index == 0) {
+			strcpy(dirent.name, "dev");
+			dirent.ino = 0;
+			return &dirent;
+		}
+		index--;
 	}
 
-	if (index - 1 >= nroot_nodes) {
+	//a directory's children are contiguous, so the index maps straight to an entry
+	initrd_entry_t* dir = &entries[node->inode];
+	if (index >= dir->length) {
 		return 0;
 	}
-	char* name = root_nodes[index - 1].name;
-	strcpy(dirent.name, name);
-	dirent.name[strlen(name)] = 0; //null terminate string
-	dirent.ino = root_nodes[index-1].inode;
+	uint32_t child = dir->offset + index;
+	strcpy(dirent.name, names + entries[child].name_offset);
+	dirent.ino = child;
 	return &dirent;
 }
 
 static fs_node_t* initrd_finddir(fs_node_t* node, char* name) {
+	if (node == initrd_dev) return 0;
 	if (node == initrd_root && !strcmp(name, "dev")) {
 		return initrd_dev;
 	}
 
-	for (int i = 0; i < nroot_nodes; i++) {
-		if (!strcmp(name, root_nodes[i].name)) {
-			return &root_nodes[i];
+	uint32_t hash = initrd_hash(node->inode, name);
+	uint32_t mask = initrd_header->bucket_count - 1;
+	//fsgen keeps the table at most half full, so probing always reaches an empty bucket
+	for (uint32_t i = hash & mask; buckets[i] != INITRD_BUCKET_EMPTY; i = (i + 1) & mask) {
+		initrd_entry_t* entry = &entries[buckets[i]];
+		if (entry->hash == hash && entry->parent == node->inode && !strcmp(names + entry->name_offset, name)) {
+			return initrd_node(buckets[i]);
 		}
 	}
 	return 0;
 }
 
+static fs_node_t* initrd_node(uint32_t index) {
+	if (nodes[index]) return nodes[index];
+
+	initrd_entry_t* entry = &entries[index];
+	fs_node_t* node = (fs_node_t*)kmalloc(sizeof(fs_node_t));
+	memset(node, 0, sizeof(fs_node_t));
+
+	const char* name = names + entry->name_offset;
+	uint32_t name_len = MIN(strlen(name), sizeof(node->name) - 1);
+	memcpy(node->name, name, name_len);
+	node->inode = index;
+
+	if (entry->flags & INITRD_ENTRY_DIR) {
+		node->flags = FS_DIRECTORY;
+		node->readdir = &initrd_readdir;
+		node->finddir = &initrd_finddir;
+	}
+	else {
+		node->flags = FS_FILE;
+		node->length = entry->length;
+		node->read = &initrd_read;
+		node->map = &initrd_map;
+	}
+
+	//root has no parent
+	if (index != INITRD_ROOT) {
+		node->parent = initrd_node(entry->parent);
+	}
+
+	nodes[index] = node;
+	return node;
+}
+
 fs_node_t* initrd_install(uint32_t location) {
-	//initialize main and file header pointers and populate root directory
+	initrd_base = location;
 	initrd_header = (initrd_header_t*)location;
-	file_headers = (initrd_file_header_t*)(location + sizeof(initrd_header_t));
+	ASSERT(initrd_header->magic == INITRD_MAGIC, "initrd has bad magic %x", initrd_header->magic);
+	ASSERT(initrd_header->version == INITRD_VERSION, "initrd is version %d, expected %d", initrd_header->version, INITRD_VERSION);
+
+	//image is used in place, so the only setup is pointing at its tables
+	entries = (initrd_entry_t*)(location + initrd_header->entries_offset);
+	buckets = (uint32_t*)(location + initrd_header->buckets_offset);
+	names = (const char*)(location + initrd_header->names_offset);
+
+	nodes = (fs_node_t**)kmalloc(sizeof(fs_node_t*) * initrd_header->entry_count);
+	memset(nodes, 0, sizeof(fs_node_t*) * initrd_header->entry_count);
 
 	//initialize root directory
-	initrd_root = (fs_node_t*)kmalloc(sizeof(fs_node_t));
+	initrd_root = initrd_node(INITRD_ROOT);
 	strcpy(initrd_root->name, "initrd");
-	initrd_root->mask = initrd_root->uid = initrd_root->gid = initrd_root->inode = initrd_root->length = 0;
-	initrd_root->flags = FS_DIRECTORY;
-	initrd_root->read = 0;
-	initrd_root->write = 0;
-	initrd_root->open = 0;
-	initrd_root->close = 0;
-	initrd_root->readdir = &initrd_readdir;
-	initrd_root->finddir = &initrd_finddir;
-	initrd_root->ptr = 0;
-	initrd_root->impl = 0;
 
 	//initializes /dev directory
 	initrd_dev = (fs_node_t*)kmalloc(sizeof(fs_node_t));
+	memset(initrd_dev, 0, sizeof(fs_node_t));
 	strcpy(initrd_dev->name, "dev");
-	initrd_dev->mask = initrd_dev->uid = initrd_dev->gid = initrd_dev->inode = initrd_dev->length = 0;
 	initrd_dev->flags = FS_DIRECTORY;
-	initrd_dev->read = 0;
-	initrd_dev->write = 0;
-	initrd_dev->open = 0;
-	initrd_dev->close = 0;
 	initrd_dev->readdir = &initrd_readdir;
 	initrd_dev->finddir = &initrd_finddir;
-	initrd_dev->ptr = 0;
-	initrd_dev->impl = 0;
 	initrd_dev->parent = initrd_root;
 
-	root_nodes = (fs_node_t*)kmalloc(sizeof(fs_node_t) * initrd_header->nfiles);
-	nroot_nodes = initrd_header->nfiles;
-
-	//for every file
-	for (uint8_t i = 0 ; i < initrd_header->nfiles; i++) {
-		//edit every file's header
-		//currently, holds file offset relative to start of ramdisk
-		//we want it relative to the start of memory
-		file_headers[i].offset += location;
-		//create new file node
-		strcpy(root_nodes[i].name, (const char*)&file_headers[i].name);
-		root_nodes[i].mask = root_nodes[i].uid = root_nodes[i].gid = 0;
-		root_nodes[i].length = file_headers[i].length;
-		root_nodes[i].inode = i;
-		root_nodes[i].flags = FS_FILE;
-		root_nodes[i].read = &initrd_read;
-		root_nodes[i].write = 0;
-		root_nodes[i].open = 0;
-		root_nodes[i].close = 0;
-		root_nodes[i].readdir = 0;
-		root_nodes[i].finddir = 0;
-		root_nodes[i].impl = 0;
-		root_nodes[i].parent = initrd_root;
+	//cache slots are empty until a compressed file is read
+	for (int i = 0; i < INITRD_CACHE_BLOCKS; i++) {
+		block_cache[i].entry = INITRD_BUCKET_EMPTY;
 	}
+	cache_lock = lock_create();
 
+	printf_info("initrd: %d entries, %d bytes", initrd_header->entry_count, initrd_header->length);
 	return initrd_root;
 }
+
+void initrd_stats(initrd_stats_t* out) {
+	stats.files = 0;
+	stats.compressed_files = 0;
+	stats.length = 0;
+	stats.stored_length = 0;
+
+	for (uint32_t i = 0; i < initrd_header->entry_count; i++) {
+		initrd_entry_t* entry = &entries[i];
+		if (!(entry->flags & INITRD_ENTRY_FILE)) continue;
+
+		stats.files++;
+		stats.length += entry->length;
+		if (entry->flags & INITRD_ENTRY_COMPRESSED) {
+			//block table ends with the offset just past the last block
+			uint32_t blocks = (entry->length + initrd_header->block_size - 1) / initrd_header->block_size;
+			uint32_t* block_offsets = (uint32_t*)(initrd_base + entry->offset);
+			stats.compressed_files++;
+			stats.stored_length += block_offsets[blocks];
+		}
+		else {
+			stats.stored_length += entry->length;
+		}
+	}
+	*out = stats;
+}
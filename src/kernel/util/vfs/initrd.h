@@ -4,20 +4,76 @@
 #include <std/common.h>
 #include "fs.h"
 
+//image layout, generated by fsgen (which keeps its own copy of these definitions):
+//initrd_header_t | initrd_entry_t[entry_count] | uint32_t buckets[bucket_count] | names | file data
+//all offsets are from the start of the image
+#define INITRD_MAGIC	0x44525841 //"AXRD"
+#define INITRD_VERSION	3
+
+//entry 0 is the root directory
+//every directory's children are stored as one contiguous run of entries
+#define INITRD_ROOT		0
+#define INITRD_ENTRY_FILE	0x1
+#define INITRD_ENTRY_DIR	0x2
+//file data is split into block_size blocks which are LZ4 compressed independently
+//data starts with uint32_t block_offsets[block count + 1], relative to the entry's offset
+//a block whose stored size equals its decoded size didn't compress and is stored as-is
+#define INITRD_ENTRY_COMPRESSED	0x4
+
+//bucket holding no entry
+#define INITRD_BUCKET_EMPTY	0xFFFFFFFF
+
 typedef struct {
-	uint32_t nfiles;	//# of files in ramdisk
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;	//files and directories, including root
+	uint32_t bucket_count;	//power of two
+	uint32_t entries_offset;
+	uint32_t buckets_offset;
+	uint32_t names_offset;	//null terminated names of every entry
+	uint32_t length;	//size of the whole image
+	uint32_t block_size;	//decoded size of every block of a compressed file but the last
 } initrd_header_t;
 
 typedef struct {
-	uint8_t magic;	//magic number
-	int8_t name[64]; //filename
-	uint32_t offset; //offset in initrd that file starts
-	uint32_t length; //length of file
-} initrd_file_header_t;
+	uint32_t name_offset;	//from names_offset
+	uint32_t hash;		//initrd_hash(parent, name)
+	uint32_t parent;	//index of containing directory
+	uint32_t flags;		//INITRD_ENTRY_FILE or INITRD_ENTRY_DIR, files may also be INITRD_ENTRY_COMPRESSED
+	uint32_t offset;	//file: start of data in image, directory: index of first child
+	uint32_t length;	//file: decoded size in bytes, directory: number of children
+} initrd_entry_t;
+
+typedef struct {
+	uint32_t files;
+	uint32_t compressed_files;
+	uint32_t length;	//decoded size of every file
+	uint32_t stored_length;	//size every file takes up in the image
+	uint32_t blocks_decoded;
+	uint32_t bytes_decoded;
+	uint32_t cache_hits;	//partial block reads served without decoding
+	uint32_t cache_misses;
+} initrd_stats_t;
+
+//FNV-1a over the parent's index followed by the entry's name
+//a name index bucket is found by masking with bucket_count - 1, then probing linearly
+static inline uint32_t initrd_hash(uint32_t parent, const char* name) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 4; i++) {
+		hash = (hash ^ ((parent >> (i * 8)) & 0xFF)) * 16777619u;
+	}
+	while (*name) {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+	return hash;
+}
 
 //initializes initial ramdisk
 //gets passed address of multiboot module,
 //and returns completed filesystem node
 fs_node_t* initrd_install(uint32_t location);
 
+//fills stats with the image's compression ratio and decoding counters so far
+void initrd_stats(initrd_stats_t* stats);
+
 #endif
@@ -0,0 +1,62 @@
+#include "lz4.h"
+#include <std/std.h>
+#include <stdbool.h>
+
+#define LZ4_MIN_MATCH 4
+
+//lengths of 15 or more continue in following bytes, each adding up to 255
+static inline bool read_length(const uint8_t** ip, const uint8_t* end, uint32_t* len) {
+	if (*len != 15) return true;
+	uint8_t b;
+	do {
+		if (*ip >= end) return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+int lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dest, uint32_t dest_len) {
+	const uint8_t* ip = src;
+	const uint8_t* ip_end = src + src_len;
+	uint8_t* op = dest;
+	uint8_t* op_end = dest + dest_len;
+
+	while (ip < ip_end) {
+		//each sequence is a token, literals, then a match
+		uint8_t token = *ip++;
+
+		uint32_t literals = token >> 4;
+		if (!read_length(&ip, ip_end, &literals)) return -1;
+		if (literals > (uint32_t)(ip_end - ip) || literals > (uint32_t)(op_end - op)) return -1;
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		//last sequence ends after its literals
+		if (ip == ip_end) break;
+
+		if (ip_end - ip < 2) return -1;
+		uint32_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > (uint32_t)(op - dest)) return -1;
+
+		uint32_t match_len = token & 0xF;
+		if (!read_length(&ip, ip_end, &match_len)) return -1;
+		match_len += LZ4_MIN_MATCH;
+		if (match_len > (uint32_t)(op_end - op)) return -1;
+
+		const uint8_t* match = op - offset;
+		if (offset >= match_len) {
+			memcpy(op, match, match_len);
+			op += match_len;
+		}
+		else {
+			//match overlaps what it's producing, so it has to be copied forwards one byte at a time
+			for (uint32_t i = 0; i < match_len; i++) {
+				*op++ = *match++;
+			}
+		}
+	}
+	return op - dest;
+}
@@ -0,0 +1,10 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <std/common.h>
+
+//decodes one LZ4 block (raw block format, no frame header) from src into dest
+//returns number of bytes written to dest, or -1 if src is malformed or wouldn't fit in dest_len
+int lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dest, uint32_t dest_len);
+
+#endif
@@ -1,5 +1,6 @@
 #include "common.h"
 #include "kheap.h"
+#include "kslab.h"
 #include <kernel/util/paging/paging.h>
 #include "std.h"
 #include <std/math.h>
@@ -19,8 +20,17 @@ static uint32_t used_bytes;
 void* kmalloc_int(uint32_t sz, int align, uint32_t* phys) {
 	//if the heap already exists, pass through
 	if (kheap) {
-		void* addr = alloc(sz, (uint8_t)align, kheap);
+		void* addr = NULL;
+		//small unaligned requests are served by size-class slabs
+		if (!align && sz <= SLAB_MAX_SIZE) {
+			addr = slab_alloc(sz);
+		}
+		if (!addr) {
+			addr = alloc(sz, (uint8_t)align, kheap);
+		}
 		if (phys) {
+			//heap pages are backed on first touch, make sure this one has a frame before reading it
+			*(volatile uint8_t*)addr;
 			page_t* page = get_page((uint32_t)addr, 0, kernel_directory);
 			*phys = page->frame * PAGE_SIZE + ((uint32_t)addr & 0xFFF);
 		}
@@ -59,70 +69,138 @@ void* kmalloc(uint32_t sz) {
 }
 
 void kfree(void* p) {
+	if (slab_owns(p)) {
+		slab_free(p);
+		return;
+	}
 	free(p, kheap);
 }
 
-static int32_t find_smallest_hole(uint32_t size, uint8_t align, heap_t* heap) {
-	//find smallest hole that will fit
-	uint32_t iterator = 0;
-	while (iterator < heap->index->size) {
-		header_t* header = (header_t*)array_o_lookup(heap->index, iterator);
-
-		//check if header is valid
-		ASSERT(header->magic == HEAP_MAGIC, "invalid header magic");
-		ASSERT(header->hole, "header %x was in free block index but was not a hole!", header);
-
-		//if user has requested memory be page aligned
-		//
-		if (align > 0) {
-			//page align starting point of header
-			uint32_t location = (uint32_t)header;
-			int32_t offset = 0;
-			if (((location + sizeof(header_t)) & 0xFFFFF000) != 0) {
-				offset = PAGE_SIZE - ((location + sizeof(header_t)) % PAGE_SIZE);
-			}
+uint32_t ksize(void* p) {
+	if (!p) return 0;
+	if (slab_owns(p)) {
+		return slab_size(p);
+	}
+
+	header_t* header = (header_t*)((uint32_t)p - sizeof(header_t));
+	ASSERT(header->magic == HEAP_MAGIC, "invalid header magic in %x (got %x)", p, header->magic);
+	return header->size - sizeof(header_t) - sizeof(footer_t);
+}
+
+//bin a hole of this size belongs in
+//bin n holds holes with sizes in [2^n, 2^(n+1))
+static inline int hole_bin(uint32_t size) {
+	return 31 - __builtin_clz(size);
+}
+
+static void hole_insert(heap_t* heap, header_t* hole) {
+	int bin = hole_bin(hole->size);
+	hole->prev_hole = NULL;
+	hole->next_hole = heap->bins[bin];
+	if (heap->bins[bin]) {
+		heap->bins[bin]->prev_hole = hole;
+	}
+	heap->bins[bin] = hole;
+	heap->bin_map |= (1 << bin);
+}
+
+static void hole_remove(heap_t* heap, header_t* hole) {
+	int bin = hole_bin(hole->size);
+	if (hole->prev_hole) {
+		hole->prev_hole->next_hole = hole->next_hole;
+	}
+	else {
+		heap->bins[bin] = hole->next_hole;
+	}
+	if (hole->next_hole) {
+		hole->next_hole->prev_hole = hole->prev_hole;
+	}
+	hole->prev_hole = hole->next_hole = NULL;
+
+	if (!heap->bins[bin]) {
+		heap->bin_map &= ~(1 << bin);
+	}
+}
+
+//number of bytes which must be skipped at the start of hole so the block's data lands on a page boundary
+//the skipped bytes become their own hole, so they're either nothing or big enough to hold a header and footer
+static uint32_t align_offset(header_t* header) {
+	uint32_t data = (uint32_t)header + sizeof(header_t);
+	uint32_t aligned = (data + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	if (aligned != data && aligned - data < sizeof(header_t) + sizeof(footer_t)) {
+		aligned += PAGE_SIZE;
+	}
+	return aligned - data;
+}
+
+static header_t* find_smallest_hole(uint32_t size, uint8_t align, heap_t* heap) {
+	int bin = hole_bin(size);
 
-			int32_t hole_size = (int32_t)header->size - offset;
-			//do we still fit?
-			if (hole_size >= (int32_t)size) break;
+	if (!align) {
+		//best fit among holes in the same size class
+		header_t* best = NULL;
+		for (header_t* header = heap->bins[bin]; header; header = header->next_hole) {
+			//check if header is valid
+			ASSERT(header->magic == HEAP_MAGIC, "invalid header magic");
+			ASSERT(header->hole, "header %x was in free block index but was not a hole!", header);
+
+			if (header->size >= size && (!best || header->size < best->size)) {
+				best = header;
+				if (best->size == size) break;
+			}
 		}
-		else if (header->size >= size) break;
+		if (best) return best;
 
-		iterator++;
+		//every hole in a larger bin is guaranteed to fit, so take the smallest populated one
+		uint32_t larger = heap->bin_map & ~((2u << bin) - 1);
+		if (!larger) return NULL;
+		return heap->bins[__builtin_ctz(larger)];
 	}
 
-	//why did the loop exit?
-	if (iterator == heap->index->size) {
-		//reached end of index and didn't find any holes small enough
-		return -1;
+	//page aligned requests also need room for the leading gap, so check each candidate
+	uint32_t candidates = heap->bin_map & ~((1u << bin) - 1);
+	while (candidates) {
+		int idx = __builtin_ctz(candidates);
+		for (header_t* header = heap->bins[idx]; header; header = header->next_hole) {
+			ASSERT(header->magic == HEAP_MAGIC, "invalid header magic");
+			if (header->size >= align_offset(header) + size) {
+				return header;
+			}
+		}
+		candidates &= ~(1 << idx);
 	}
+	return NULL;
+}
 
-	return iterator;
+//writes footer for block or hole described by header
+static void write_footer(header_t* header) {
+	footer_t* footer = (footer_t*)((uint32_t)header + header->size - sizeof(footer_t));
+	footer->magic = HEAP_MAGIC;
+	footer->header = header;
 }
 
-static int8_t header_t_less_than(void* a, void* b) {
-	return (((header_t*)a)->size < ((header_t*)b)->size);
+//finds the hole ending at addr, if there is one
+//the footer immediately below a block boundary gives us address-ordered neighbours without an index
+static header_t* hole_ending_at(heap_t* heap, uint32_t addr) {
+	if (addr < heap->start_address + sizeof(header_t) + sizeof(footer_t)) return NULL;
+
+	footer_t* footer = (footer_t*)(addr - sizeof(footer_t));
+	if (footer->magic != HEAP_MAGIC) return NULL;
+
+	header_t* header = footer->header;
+	if ((uint32_t)header < heap->start_address || (uint32_t)header >= addr) return NULL;
+	if (header->magic != HEAP_MAGIC || !header->hole) return NULL;
+	return header;
 }
 
 heap_t* create_heap(uint32_t start, uint32_t end_addr, uint32_t max, uint8_t supervisor, uint8_t readonly) {
 	heap_t* heap = (heap_t*)kmalloc(sizeof(heap_t));
+	memset(heap, 0, sizeof(heap_t));
 
 	//start and end MUST be page aligned
 	ASSERT(start % PAGE_SIZE == 0, "start wasn't page aligned");
 	ASSERT(end_addr % PAGE_SIZE == 0, "end_addr wasn't page aligned");
 
-	//initialize index
-	heap->index = array_o_place((void*)start, HEAP_INDEX_SIZE, &header_t_less_than);
-
-	//shift start address forward to resemble where we can start putting data
-	start += sizeof(type_t) * HEAP_INDEX_SIZE;
-
-	//make sure start is still page aligned)
-	if ((start & 0xFFFFF000) != 0) {
-		start &= 0xFFFFF000;
-		start += PAGE_SIZE;
-	}
-
 	//write start, end, and max addresses into heap structure
 	heap->start_address = start;
 	heap->end_address = end_addr;
@@ -130,22 +208,26 @@ heap_t* create_heap(uint32_t start, uint32_t end_addr, uint32_t max, uint8_t sup
 	heap->supervisor = supervisor;
 	heap->readonly = readonly;
 
+	//heap pages are only given frames once they're touched
+	vmem_reserve(start, end_addr - start, supervisor, !readonly);
+
 	//we start off with one large hole in the index
 	//this represents the whole heap at this point
 	header_t* hole = (header_t*)start;
 	hole->size = end_addr - start;
 	hole->magic = HEAP_MAGIC;
 	hole->hole = 1;
-	array_o_insert(heap->index, (void*)hole);
+	write_footer(hole);
+	hole_insert(heap, hole);
 
 	return heap;
 }
 
 void expand(uint32_t new_size, heap_t* heap) {
 	//sanity check
-	ASSERT(new_size > heap->end_address - heap->start_address, "new_size was larger than heap");
+	ASSERT(new_size > heap->end_address - heap->start_address, "new_size was smaller than heap");
 	//get nearest page boundary
-	if ((new_size & 0xFFFFF000) != 0) {
+	if ((new_size & 0xFFF) != 0) {
 		new_size &= 0xFFFFF000;
 		new_size += PAGE_SIZE;
 	}
@@ -155,36 +237,43 @@ void expand(uint32_t new_size, heap_t* heap) {
 
 	//this *should* always be on a page boundary
 	uint32_t old_size = heap->end_address - heap->start_address;
-	uint32_t i = old_size;
+	uint32_t old_end_address = heap->end_address;
 
 	//do expansion
-	while (i < new_size) {
-		//printf_info("allocating page at %x", heap->start_address + i);
-		alloc_frame(get_page(heap->start_address + i, 1, kernel_directory), heap->supervisor, !heap->readonly);
-		i += PAGE_SIZE;
-	}
+	//frames are allocated by the page fault handler as the new space gets used
+	vmem_reserve(heap->start_address + old_size, new_size - old_size, heap->supervisor, !heap->readonly);
 	heap->end_address = heap->start_address + new_size;
+
+	//new space either extends the hole at the old end of the heap, or becomes a hole of its own
+	header_t* header = hole_ending_at(heap, old_end_address);
+	if (header) {
+		hole_remove(heap, header);
+		header->size += heap->end_address - old_end_address;
+	}
+	else {
+		header = (header_t*)old_end_address;
+		header->magic = HEAP_MAGIC;
+		header->hole = 1;
+		header->size = heap->end_address - old_end_address;
+	}
+	write_footer(header);
+	hole_insert(heap, header);
 }
 
-static uint32_t contract(int32_t new_size, heap_t* heap) {
-	//sanity check
-	ASSERT((uint32_t)new_size < heap->end_address - heap->start_address, "new_size was larger than heap");
+static uint32_t contract(uint32_t new_size, heap_t* heap) {
+	uint32_t old_size = heap->end_address - heap->start_address;
 
 	//get nearest page boundary
-	if (new_size & PAGE_SIZE) {
-		new_size &= PAGE_SIZE;
+	if (new_size & 0xFFF) {
+		new_size &= 0xFFFFF000;
 		new_size += PAGE_SIZE;
 	}
 
 	//don't contract too far
-	new_size = MAX(new_size, HEAP_MIN_SIZE);
+	new_size = MAX(new_size, (uint32_t)HEAP_MIN_SIZE);
+	if (new_size >= old_size) return old_size;
 
-	int32_t old_size = heap->end_address - heap->start_address;
-	int32_t i = old_size - PAGE_SIZE;
-	while (new_size < i) {
-		free_frame(get_page(heap->start_address + i, 0, current_directory == 0 ? kernel_directory : current_directory));
-		i -= PAGE_SIZE;
-	}
+	vmem_release(heap->start_address + new_size, old_size - new_size);
 	heap->end_address = heap->start_address + new_size;
 	return new_size;
 }
@@ -193,66 +282,44 @@ void* alloc(uint32_t size, uint8_t align, heap_t* heap) {
 	//make sure we take size of header/footer into account
 	uint32_t new_size = size + sizeof(header_t) + sizeof(footer_t);
 	//find smallest hole that will fit
-	int32_t iterator = find_smallest_hole(new_size, align, heap);
+	header_t* orig_hole_header = find_smallest_hole(new_size, align, heap);
 
-	if (iterator == -1) {
+	if (!orig_hole_header) {
 		//no free hole large enough was found
-
-		//save some previous data
-		uint32_t old_length = heap->end_address - heap->start_address;
-		uint32_t old_end_address = heap->end_address;
-
 		//we need to allocate more space
-		expand(old_length + new_size, heap);
-		uint32_t new_length = heap->end_address - heap->start_address;
-
-		//find last header
-		iterator = 0;
-		//hold index of and value of endmost header found so far
-		int32_t idx = -1;
-		uint32_t val = 0x0;
-		while (iterator < heap->index->size) {
-			uint32_t tmp = (uint32_t)array_o_lookup(heap->index, iterator);
-			if (tmp > val) {
-				val = tmp;
-				idx = iterator;
-			}
-			iterator++;
-		}
-
-		//if we didn't find any headers, add one
-		if (idx == -1) {
-			header_t* header = (header_t*)old_end_address;
-			header->magic = HEAP_MAGIC;
-			header->hole = 1;
-			header->size = new_length - old_length;
-
-			footer_t* footer = (footer_t*)(old_end_address + header->size - sizeof(footer_t));
-			footer->magic = HEAP_MAGIC;
-			footer->header = header;
-			array_o_insert(heap->index, (void*)header);
-		}
-		else {
-			//last header needs adjusting
-			header_t* header = (header_t*)array_o_lookup(heap->index, idx);
-			header->size += new_length - old_length;
-
-			//rewrite footer
-			footer_t* footer = (footer_t*)((uint32_t)header + header->size - sizeof(footer_t));
-			footer->header = header;
-			footer->magic = HEAP_MAGIC;
-		}
+		//expand() folds the new space into the hole at the end of the heap
+		uint32_t old_length = heap->end_address - heap->start_address;
+		expand(old_length + new_size + (align ? PAGE_SIZE : 0), heap);
 
 		//we should now have enough space
 		//try allocation again
-		printf_info("alloc added header, retrying allocation (heap %x)", new_size);
+		printf_info("alloc expanded heap, retrying allocation (heap %x)", new_size);
 		return alloc(size, align, heap);
 	}
 
-	header_t* orig_hole_header = (header_t*)array_o_lookup(heap->index, iterator);
+	//we don't need this hole in the index any more
+	hole_remove(heap, orig_hole_header);
+
 	uint32_t orig_hole_pos = (uint32_t)orig_hole_header;
 	uint32_t orig_hole_size = orig_hole_header->size;
 
+	//if it needs to be page aligned, do it now and
+	//make a new hole in front of our block
+	if (align) {
+		uint32_t offset = align_offset(orig_hole_header);
+		if (offset) {
+			header_t* hole_header = (header_t*)orig_hole_pos;
+			hole_header->size = offset;
+			hole_header->magic = HEAP_MAGIC;
+			hole_header->hole = 1;
+			write_footer(hole_header);
+			hole_insert(heap, hole_header);
+
+			orig_hole_pos += offset;
+			orig_hole_size -= offset;
+		}
+	}
+
 	//check if we should split hole into 2 parts
 	//this is only worth it if the new hole's size is greater than the
 	//size we need to store the header and footer
@@ -262,63 +329,39 @@ void* alloc(uint32_t size, uint8_t align, heap_t* heap) {
 		new_size = orig_hole_size;
 	}
 
-	//if it needs to be page aligned, do it now and
-	//make a new hole in front of our block
-	if (align && (orig_hole_pos & 0xFFFFF000)) {
-		uint32_t new_location = orig_hole_pos + PAGE_SIZE - (orig_hole_pos & 0xFFF) - sizeof(header_t);
-		header_t* hole_header = (header_t*)orig_hole_pos;
-		hole_header->size = PAGE_SIZE - (orig_hole_pos & 0xFFF) - sizeof(header_t);
-		hole_header->magic = HEAP_MAGIC;
-		hole_header->hole = 1;
-		footer_t* hole_footer = (footer_t*)((uint32_t)new_location - sizeof(footer_t));
-		hole_footer->magic = HEAP_MAGIC;
-		hole_footer->header = hole_header;
-		orig_hole_pos = new_location;
-		orig_hole_size = orig_hole_size - hole_header->size;
-	}
-	else {
-		//we don't need this hole any more, delete it from index
-		array_o_remove(heap->index, iterator);
-	}
-
 	//overwrite original header
 	header_t* block_header = (header_t*)orig_hole_pos;
 	block_header->magic = HEAP_MAGIC;
 	block_header->hole = 0;
 	block_header->size = new_size;
+	block_header->prev_hole = block_header->next_hole = NULL;
 	//and overwrite footer
-	footer_t* block_footer = (footer_t*)(orig_hole_pos + sizeof(header_t) + size);
-	block_footer->magic = HEAP_MAGIC;
-	block_footer->header = block_header;
+	write_footer(block_header);
 
 	//we might have to write a new hole after the allocated block
 	//only do this if the new hole would have a positive size after
 	//subtracting size needed for header and footer
 	if (orig_hole_size - new_size > 0) {
-		header_t* hole_header = (header_t*)(orig_hole_pos + sizeof(header_t) + size + sizeof(footer_t));
+		header_t* hole_header = (header_t*)(orig_hole_pos + new_size);
 		hole_header->magic = HEAP_MAGIC;
 		hole_header->hole = 1;
 		hole_header->size = orig_hole_size - new_size;
-
-		footer_t* hole_footer = (footer_t*)((uint32_t)hole_header + orig_hole_size - new_size - sizeof(footer_t));
-		if ((uint32_t)hole_footer < heap->end_address) {
-			hole_footer->magic = HEAP_MAGIC;
-			hole_footer->header = hole_header;
-		}
+		write_footer(hole_header);
 
 		//put new hole in index
-		array_o_insert(heap->index, (void*)hole_header);
+		hole_insert(heap, hole_header);
 	}
 
 	//add this allocation to used memory
-	used_bytes += size;
+	used_bytes += new_size;
 
 	return (void*)((uint32_t)block_header + sizeof(header_t));
 }
 
 void heap_int_test() {
 	for (int i = 1; i < 1024; i++) {
-		char* c = kmalloc(73);
+		//go straight to the hole allocator, slab objects have no header/footer
+		char* c = alloc(73, 0, kheap);
 
 		//get header and footer associated with this pointer
 		header_t* header = (header_t*)((uint32_t)c - sizeof(header_t));
@@ -326,16 +369,16 @@ void heap_int_test() {
 
 		if (header->magic != HEAP_MAGIC) {
 			printf_err("heap_int_test(): invalid header magic (got %x)", header->magic);
-			kfree(c);
+			free(c, kheap);
 			return;
 		}
 		if (footer->magic != HEAP_MAGIC) {
 			printf_err("heap_int_test(): invalid footer magic (got %x)", footer->magic);
-			kfree(c);
+			free(c, kheap);
 			return;
 		}
 
-		kfree(c);
+		free(c, kheap);
 	}
 	printf_info("heap_int_test(): test passed normally");
 }
@@ -357,68 +400,36 @@ void free(void* p, heap_t* heap) {
 	//turn this into a hole
 	header->hole = 1;
 
-	//determine if we should add this header into free holes index
-	char add = 1;
-
 	//attempt merge left
-	//if thing to left of us is a footer...
-	footer_t* test_footer = (footer_t*)((uint32_t)header - sizeof(footer_t));
-	if (test_footer->magic == HEAP_MAGIC && test_footer->header->hole) {
-		uint32_t cache_size = header->size; //cache current size
-		header = test_footer->header; //rewrite header with new one
-		footer->header = header; //rewrite footer to point to new header
-		header->size += cache_size; //change size
-		add = 0; //since header is already in index, don't add it again
+	//if thing to left of us is a hole, it absorbs us
+	header_t* left = hole_ending_at(heap, (uint32_t)header);
+	if (left) {
+		hole_remove(heap, left);
+		left->size += header->size;
+		header = left;
+		footer->header = header;
 	}
 
 	//attempt merge right
-	//if thing to right of us is a header...
-	header_t* test_header = (header_t*)((uint32_t)footer + sizeof(footer_t));
-	if (test_header->magic == HEAP_MAGIC && test_header->hole) {
-		header->size += test_header->size; //increase size to fit merged hole
-		test_footer = (footer_t*)((uint32_t)test_header + test_header->size - sizeof(footer_t)); //rewrite its footer to point to our header
-		footer = test_footer;
-
-		//find and remove this header from index
-		for (int i = 0; i < heap->index->size; i++) {
-			header_t* tmp = array_o_lookup(heap->index, i);
-			if (tmp == test_header) {
-				array_o_remove(heap->index, i);
-				break;
-			}
-		}
+	//if thing to right of us is a hole, we absorb it
+	header_t* right = (header_t*)((uint32_t)footer + sizeof(footer_t));
+	if ((uint32_t)right < heap->end_address && right->magic == HEAP_MAGIC && right->hole) {
+		hole_remove(heap, right);
+		header->size += right->size;
+		footer = (footer_t*)((uint32_t)header + header->size - sizeof(footer_t));
+		footer->header = header;
 	}
 
 	//if footer location is the end address, we can contract
+	//always leave room for this hole's own header and footer
 	if ((uint32_t)footer + sizeof(footer_t) == heap->end_address) {
 		uint32_t old_length = heap->end_address - heap->start_address;
-		uint32_t new_length = contract((uint32_t)header - heap->start_address, heap);
-		//check how big we'll be after resizing
-		if (header->size - (old_length - new_length) > 0) {
-			//we still exist, so resize us
-			header->size -= old_length - new_length;
-			footer = (footer_t*)((uint32_t)header + header->size - sizeof(footer_t));
-			footer->magic = HEAP_MAGIC;
-			footer->header = header;
-		}
-		else {
-			//we no longer exist
-			//remove us from index
-			uint32_t iterator = 0;
-			while ((iterator < heap->index->size) && (array_o_lookup(heap->index, iterator) != (void*)test_header)) {
-				iterator++;
-			}
-
-			//if we didn't find ourselves, we have nothing to remove
-			if (iterator < heap->index->size) {
-				array_o_remove(heap->index, iterator);
-			}
-		}
+		uint32_t new_length = contract((uint32_t)header - heap->start_address + sizeof(header_t) + sizeof(footer_t), heap);
+		header->size -= old_length - new_length;
+		write_footer(header);
 	}
 
-	if (add == 1) {
-		array_o_insert(heap->index, (void*)header);
-	}
+	hole_insert(heap, header);
 }
 
 uint32_t used_mem() {
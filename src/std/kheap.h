@@ -2,7 +2,7 @@
 #define STD_KHEAP_H
 
 #include "std_base.h"
-#include "array_o.h"
+#include "array_m.h"
 #include <stdint.h>
 
 __BEGIN_DECLS
@@ -24,15 +24,17 @@ STDAPI void* kmalloc(uint32_t sz);
 //#define KHEAP_MAX_ADDRESS	0xFFFFF000
 #define KHEAP_MAX_ADDRESS 	0xCFFFF000
 
-#define HEAP_INDEX_SIZE		0x20000
+#define HEAP_BIN_COUNT		32
 #define HEAP_MAGIC		0x25A56F9C
 #define HEAP_MIN_SIZE		0x70000
 
 //size information for hole/block
-typedef struct {
+typedef struct header {
 	uint32_t magic; //magic number
 	uint8_t hole; //block or hole?
 	uint32_t size; //size, including end footer
+	struct header* prev_hole; //neighbours in this hole's size bin
+	struct header* next_hole;
 } header_t;
 
 typedef struct {
@@ -41,7 +43,9 @@ typedef struct {
 } footer_t;
 
 typedef struct {
-	array_o* index;
+	//segregated free lists of holes, bin n holds holes sized [2^n, 2^(n+1))
+	header_t* bins[HEAP_BIN_COUNT];
+	uint32_t bin_map; //bit n is set if bin n is non-empty
 	uint32_t start_address; //start of allocated space
 	uint32_t end_address; //end of allocated space (can be expanded up to max_address)
 	uint32_t max_address; //maximum address heap can be expanded to
@@ -61,6 +65,9 @@ STDAPI void free(void* p, heap_t* heap);
 //releases block allocated with alloc using current heap
 STDAPI void kfree(void* p);
 
+//returns usable size of block allocated with kmalloc
+STDAPI uint32_t ksize(void* p);
+
 //enlarges heap to new_size
 void expand(uint32_t new_size, heap_t* heap);
 
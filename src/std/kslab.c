@@ -0,0 +1,214 @@
+#include "kslab.h"
+#include "kheap.h"
+#include "std.h"
+
+#define PAGE_SIZE 0x1000 /* 4kb page */
+
+//objects begin after the slab header, rounded up so every object stays 16-byte aligned
+#define SLAB_HEADER_SIZE ((sizeof(slab_t) + 15) & ~15)
+
+//one entry per page of kernel heap address space
+//0 means the page isn't part of a slab, otherwise the page is (n - 1) pages past the start of its slab
+#define SLAB_MAP_SIZE ((KHEAP_MAX_ADDRESS - KHEAP_START) / PAGE_SIZE)
+static uint8_t slab_map[SLAB_MAP_SIZE];
+
+static slab_class_t classes[SLAB_CLASS_COUNT];
+static bool classes_ready = false;
+
+extern heap_t* kheap;
+
+static void slab_init_classes() {
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		slab_class_t* class = &classes[i];
+		memset(class, 0, sizeof(slab_class_t));
+		class->obj_size = SLAB_MIN_SIZE << i;
+
+		//large classes span several pages so each slab still holds a useful number of objects
+		uint32_t bytes = SLAB_HEADER_SIZE + (class->obj_size * SLAB_MIN_OBJECTS);
+		class->slab_pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+		class->objs_per_slab = ((class->slab_pages * PAGE_SIZE) - SLAB_HEADER_SIZE) / class->obj_size;
+	}
+	classes_ready = true;
+}
+
+//index of smallest class which fits size
+static inline int slab_class_index(uint32_t size) {
+	if (size <= SLAB_MIN_SIZE) return 0;
+	//round up to the next power of two, then find its distance from SLAB_MIN_SIZE
+	return (32 - __builtin_clz(size - 1)) - SLAB_MIN_SHIFT;
+}
+
+static inline uint32_t slab_map_index(uint32_t addr) {
+	return (addr - KHEAP_START) / PAGE_SIZE;
+}
+
+static void partial_push(slab_class_t* class, slab_t* slab) {
+	slab->prev = NULL;
+	slab->next = class->partial;
+	if (class->partial) {
+		class->partial->prev = slab;
+	}
+	class->partial = slab;
+}
+
+static void partial_remove(slab_class_t* class, slab_t* slab) {
+	if (slab->prev) {
+		slab->prev->next = slab->next;
+	}
+	else {
+		class->partial = slab->next;
+	}
+	if (slab->next) {
+		slab->next->prev = slab->prev;
+	}
+	slab->prev = slab->next = NULL;
+}
+
+static slab_t* slab_create(int class_idx) {
+	slab_class_t* class = &classes[class_idx];
+
+	slab_t* slab = (slab_t*)alloc(class->slab_pages * PAGE_SIZE, 1, kheap);
+	if (!slab) return NULL;
+
+	slab->magic = SLAB_MAGIC;
+	slab->class_idx = class_idx;
+	slab->inuse = 0;
+
+	//thread freelist through every object, lowest address first
+	uint8_t* objects = (uint8_t*)slab + SLAB_HEADER_SIZE;
+	slab->freelist = objects;
+	for (uint32_t i = 0; i < class->objs_per_slab - 1; i++) {
+		*(void**)(objects + (i * class->obj_size)) = objects + ((i + 1) * class->obj_size);
+	}
+	*(void**)(objects + ((class->objs_per_slab - 1) * class->obj_size)) = NULL;
+
+	//tag every page backing this slab so frees can find the header
+	uint32_t idx = slab_map_index((uint32_t)slab);
+	for (uint32_t i = 0; i < class->slab_pages; i++) {
+		slab_map[idx + i] = i + 1;
+	}
+
+	partial_push(class, slab);
+	class->slab_count++;
+	class->empty_count++;
+	return slab;
+}
+
+static void slab_destroy(slab_class_t* class, slab_t* slab) {
+	partial_remove(class, slab);
+
+	uint32_t idx = slab_map_index((uint32_t)slab);
+	for (uint32_t i = 0; i < class->slab_pages; i++) {
+		slab_map[idx + i] = 0;
+	}
+
+	slab->magic = 0;
+	class->slab_count--;
+	class->empty_count--;
+	free(slab, kheap);
+}
+
+bool slab_owns(void* p) {
+	uint32_t addr = (uint32_t)p;
+	if (addr < KHEAP_START || addr >= KHEAP_MAX_ADDRESS) return false;
+	return slab_map[slab_map_index(addr)] != 0;
+}
+
+static slab_t* slab_from_ptr(void* p) {
+	uint32_t addr = (uint32_t)p;
+	uint32_t page = addr & ~(PAGE_SIZE - 1);
+	slab_t* slab = (slab_t*)(page - ((slab_map[slab_map_index(addr)] - 1) * PAGE_SIZE));
+	ASSERT(slab->magic == SLAB_MAGIC, "invalid slab magic for %x (got %x)", p, slab->magic);
+	return slab;
+}
+
+void* slab_alloc(uint32_t size) {
+	if (size > SLAB_MAX_SIZE) return NULL;
+	if (!classes_ready) slab_init_classes();
+
+	int class_idx = slab_class_index(size);
+	slab_class_t* class = &classes[class_idx];
+
+	slab_t* slab = class->partial;
+	if (slab) {
+		class->hits++;
+	}
+	else {
+		slab = slab_create(class_idx);
+		if (!slab) return NULL;
+		class->misses++;
+	}
+
+	//slab is about to stop being empty
+	if (!slab->inuse) {
+		class->empty_count--;
+	}
+
+	void* obj = slab->freelist;
+	slab->freelist = *(void**)obj;
+	slab->inuse++;
+	class->inuse++;
+
+	//full slabs leave the partial list until something is freed back into them
+	if (!slab->freelist) {
+		partial_remove(class, slab);
+	}
+	return obj;
+}
+
+void slab_free(void* p) {
+	if (!p) return;
+
+	slab_t* slab = slab_from_ptr(p);
+	slab_class_t* class = &classes[slab->class_idx];
+
+	bool was_full = (slab->freelist == NULL);
+	*(void**)p = slab->freelist;
+	slab->freelist = p;
+	slab->inuse--;
+	class->inuse--;
+	class->frees++;
+
+	if (was_full) {
+		partial_push(class, slab);
+	}
+
+	if (!slab->inuse) {
+		class->empty_count++;
+		//keep a single empty slab cached to absorb alloc/free churn,
+		//hand any others back to kheap
+		if (class->empty_count > 1) {
+			slab_destroy(class, slab);
+		}
+	}
+}
+
+uint32_t slab_size(void* p) {
+	slab_t* slab = slab_from_ptr(p);
+	return classes[slab->class_idx].obj_size;
+}
+
+void slab_stats() {
+	printf("-----------------------slab-----------------------\n");
+	if (!classes_ready) {
+		printf("no slab allocations yet\n");
+		return;
+	}
+
+	uint32_t total_hits = 0;
+	uint32_t total_misses = 0;
+	for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+		slab_class_t* class = &classes[i];
+		uint32_t capacity = class->slab_count * class->objs_per_slab;
+		uint32_t occupancy = capacity ? (class->inuse * 100) / capacity : 0;
+
+		printf("%d b: %d slabs, %d/%d objs (%d%%), %d hits, %d misses, %d frees\n", class->obj_size, class->slab_count, class->inuse, capacity, occupancy, class->hits, class->misses, class->frees);
+
+		total_hits += class->hits;
+		total_misses += class->misses;
+	}
+
+	uint32_t total = total_hits + total_misses;
+	printf("%d of %d allocations avoided the hole index\n", total_hits, total);
+	printf("---------------------------------------------------\n");
+}
@@ -0,0 +1,62 @@
+#ifndef STD_KSLAB_H
+#define STD_KSLAB_H
+
+#include "std_base.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+__BEGIN_DECLS
+
+//size classes are powers of two from SLAB_MIN_SIZE to SLAB_MAX_SIZE
+//anything larger (or page aligned) falls through to the kheap hole allocator
+#define SLAB_MIN_SHIFT		4
+#define SLAB_MIN_SIZE		(1 << SLAB_MIN_SHIFT)
+#define SLAB_MAX_SIZE		2048
+#define SLAB_CLASS_COUNT	8
+//every slab holds at least this many objects, so large classes span several pages
+#define SLAB_MIN_OBJECTS	8
+#define SLAB_MAGIC		0x51AB0B1E
+
+//header placed at the start of every slab
+typedef struct slab {
+	uint32_t magic;
+	uint16_t class_idx; //size class this slab carves objects for
+	uint16_t inuse; //objects currently handed out from this slab
+	void* freelist; //singly linked list threaded through free objects
+	struct slab* prev; //links in owning class's partial list
+	struct slab* next;
+} slab_t;
+
+typedef struct slab_class {
+	uint32_t obj_size; //size of every object in this class
+	uint32_t slab_pages; //pages backing each slab
+	uint32_t objs_per_slab; //objects that fit in one slab
+	slab_t* partial; //slabs with at least one free object
+
+	uint32_t slab_count; //slabs currently owned by this class
+	uint32_t empty_count; //slabs with no objects in use
+	uint32_t inuse; //objects currently handed out
+	uint32_t hits; //allocations served from an existing slab
+	uint32_t misses; //allocations which had to fetch a new slab from kheap
+	uint32_t frees; //objects returned to this class
+} slab_class_t;
+
+//allocates object from the smallest size class that fits size
+//returns NULL if size is too large to be served by a slab
+STDAPI void* slab_alloc(uint32_t size);
+
+//returns object allocated with slab_alloc to its slab
+STDAPI void slab_free(void* p);
+
+//returns true if p lies within a slab
+STDAPI bool slab_owns(void* p);
+
+//returns usable size of object allocated with slab_alloc
+STDAPI uint32_t slab_size(void* p);
+
+//prints per-class hit/miss/occupancy counters
+STDAPI void slab_stats();
+
+__END_DECLS
+
+#endif // STD_KSLAB_H
@@ -92,18 +92,10 @@ void* calloc(size_t num, size_t size) {
 	return mem;
 }
 
-static size_t getsize(void* p) {
-	size_t* in = (size_t*)p;
-	if (in) {
-		--in;
-		return *in;
-	}
-	return -1;
-}
-
 void* realloc(void* ptr, size_t size) {
 	void* newptr;
-	size_t msize = getsize(ptr);
+	if (!ptr) return kmalloc(size);
+	size_t msize = ksize(ptr);
 	if (size <= msize) return ptr;
 
 	newptr = (void*)kmalloc(size);
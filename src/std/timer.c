@@ -1,86 +1,152 @@
 #include "timer.h"
 #include <limits.h>
 #include <std/memory.h>
+#include <std/std.h>
 #include <kernel/drivers/rtc/clock.h>
 #include <kernel/util/syscall/sysfuncs.h>
 
-int callback_num;
-static timer_callback callback_table[MAX_CALLBACKS];
+//binary min-heap of pending callbacks, earliest fire_at at index 0
+static timer_callback callback_heap[MAX_CALLBACKS];
+static int callback_num;
 
-static void clear_table() {
-	memset(&callback_table, 0, sizeof(timer_callback) * callback_num);
-	callback_num = 0;
+//true if a fires before b
+//compares difference rather than raw ticks so this survives the tick counter wrapping
+static inline bool fires_before(timer_callback* a, timer_callback* b) {
+	return (int32_t)(a->fire_at - b->fire_at) < 0;
 }
 
-static int next_open_callback_index() {
-	for (int i = 0; i < callback_num; i++) {
-		if (!callback_table[i].callback) {
-			//this index doesn't have valid data, fit for reuse
-			return i;
+static void heap_swap(int a, int b) {
+	timer_callback tmp = callback_heap[a];
+	callback_heap[a] = callback_heap[b];
+	callback_heap[b] = tmp;
+}
+
+static void sift_up(int idx) {
+	while (idx > 0) {
+		int parent = (idx - 1) / 2;
+		if (!fires_before(&callback_heap[idx], &callback_heap[parent])) break;
+		heap_swap(idx, parent);
+		idx = parent;
+	}
+}
+
+static void sift_down(int idx) {
+	while (1) {
+		int left = (idx * 2) + 1;
+		int right = left + 1;
+		int smallest = idx;
+
+		if (left < callback_num && fires_before(&callback_heap[left], &callback_heap[smallest])) {
+			smallest = left;
 		}
+		if (right < callback_num && fires_before(&callback_heap[right], &callback_heap[smallest])) {
+			smallest = right;
+		}
+		if (smallest == idx) break;
+
+		heap_swap(idx, smallest);
+		idx = smallest;
 	}
-	//all indexes up to callback_num are in use, so return callback_num
-	return callback_num;
 }
 
-timer_callback add_callback(void* callback, int interval, bool repeats, void* context) {
-	int next_open_index = next_open_callback_index();
-	//only add callback if we have room
-	if (callback_num + 1 < MAX_CALLBACKS || next_open_index < callback_num) {
-		callback_table[callback_num].callback = callback;
-		callback_table[callback_num].interval = interval;
-		callback_table[callback_num].time_left = interval;
-		callback_table[callback_num].repeats = repeats;
-		callback_table[callback_num].context = context;
-
-		callback_num++;
-
-		return callback_table[callback_num];
+static bool heap_push(timer_callback callback) {
+	if (callback_num >= MAX_CALLBACKS) return false;
+
+	callback_heap[callback_num] = callback;
+	sift_up(callback_num++);
+	return true;
+}
+
+static void heap_remove(int idx) {
+	callback_num--;
+	if (idx == callback_num) return;
+
+	//move last entry into the hole, then restore heap order in whichever direction it's out of place
+	callback_heap[idx] = callback_heap[callback_num];
+	sift_up(idx);
+	sift_down(idx);
+}
+
+//interrupts must be off, so callers can arm a callback and act on it before it can fire
+static timer_callback callback_push(void* callback, int interval, bool repeats, void* context) {
+	timer_callback entry;
+	entry.callback = callback;
+	entry.interval = interval;
+	entry.fire_at = time() + interval;
+	entry.repeats = repeats;
+	entry.context = context;
+
+	if (!heap_push(entry)) {
+		printf_err("add_callback(): callback table full (%d entries)", MAX_CALLBACKS);
+		memset(&entry, 0, sizeof(timer_callback));
 	}
+	return entry;
+}
 
-	//TODO expand table instead of clearing it
-	clear_table();
-	//try adding the callback again now that we know the table has room
-	return add_callback(callback, interval, repeats, context);
+timer_callback add_callback(void* callback, int interval, bool repeats, void* context) {
+	kernel_begin_critical();
+	timer_callback entry = callback_push(callback, interval, repeats, context);
+	kernel_end_critical();
+	return entry;
 }
 
 void remove_callback(timer_callback callback) {
-	//find this callback in callback table
+	kernel_begin_critical();
+	//find this callback in callback heap
 	for (int i = 0; i < callback_num; i++) {
-		if (callback_table[callback_num].callback == callback.callback) {
-			memset(&callback_table[i], 0, sizeof(timer_callback));
+		if (callback_heap[i].callback == callback.callback && callback_heap[i].context == callback.context) {
+			heap_remove(i);
+			break;
 		}
 	}
+	kernel_end_critical();
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
 void handle_tick(uint32_t tick) {
-	//look through every callback and see if we should fire
-	for (int i = 0; i < callback_num; i++) {
-		//decrement time left
-		callback_table[i].time_left -= 1;
+	//fire everything which is due
+	//the heap is only ever consistent between callbacks, since a callback might switch tasks
+	while (callback_num && (int32_t)(callback_heap[0].fire_at - tick) <= 0) {
+		timer_callback entry = callback_heap[0];
+		heap_remove(0);
 
-		//if it's time to fire, do so
-		if (callback_table[i].time_left <= 0) {
-			//reset for next firing
-			callback_table[i].time_left = callback_table[i].interval;
+		//reschedule for next firing
+		if (entry.repeats) {
+			entry.fire_at += entry.interval;
+			heap_push(entry);
+		}
 
-			void(*callback_func)(void*) = (void(*)(void*))callback_table[i].callback;
-			callback_func(callback_table[i].context);
+		void(*callback_func)(void*) = (void(*)(void*))entry.callback;
+		callback_func(entry.context);
+	}
+}
 
-			//if we only fire once, trash this callback
-			if (!callback_table[i].repeats) {
-				remove_callback(callback_table[i]);
-			}
-		}
+//wakes a task which went to sleep in sleep()
+static void wake_sleeper(void* context) {
+	task_t* task = (task_t*)context;
+	if (task->state == PIT_WAIT) {
+		unblock_task(task);
 	}
 }
-#pragma GCC diagnostic pop
 
 void sleep(uint32_t ms) {
-	uint32_t end = time() + ms;
-    extern task_t* current_task;
-    current_task->wake_timestamp = end;
-    sys_yield(PIT_WAIT);
+	extern task_t* current_task;
+
+	//no scheduler to wake us, just wait for the ticks to pass
+	if (!tasking_installed()) {
+		uint32_t end = time() + ms;
+		while ((int32_t)(end - time()) > 0) {
+			asm volatile("hlt");
+		}
+		return;
+	}
+
+	kernel_begin_critical();
+	current_task->wake_timestamp = time() + ms;
+	//arm the wakeup without add_callback, whose kernel_end_critical() would let it fire
+	//before we're marked PIT_WAIT. block_task sets our state before interrupts come back on,
+	//so a wakeup that fires any time after that finds us waiting
+	timer_callback wake = callback_push((void*)wake_sleeper, ms, false, current_task);
+	ASSERT(wake.callback, "sleep(): couldn't schedule wakeup for %s", current_task->name);
+	sys_yield(PIT_WAIT);
+	kernel_end_critical();
 }
@@ -12,12 +12,18 @@ __BEGIN_DECLS
 typedef struct {
 	void* callback;
 	uint32_t interval;
-	uint32_t time_left;
+	uint32_t fire_at; //tick this callback fires on next
 	bool repeats;
 	void* context;
 } timer_callback;
 
+//blocks current task for at least ms
+//woken by the tick handler, nothing polls for sleepers
 STDAPI void sleep(uint32_t ms);
+
+//calls callback(context) after interval ticks, and every interval ticks after that if repeats is set
+//pending callbacks are kept in a min-heap ordered by fire_at, so each tick only looks at the earliest one
+//returns callback with a NULL callback field if there was no room
 STDAPI timer_callback add_callback(void* callback, int interval, bool repeats, void* context);
 STDAPI void remove_callback(timer_callback callback);
 
@@ -6,6 +6,8 @@
 #include <gfx/lib/shader.h>
 #include <kernel/drivers/vga/vga.h>
 #include <kernel/util/multitasking/tasks/task.h>
+#include <kernel/util/fpu/fpu.h>
+#include <kernel/drivers/rtc/clock.h>
 
 //draw Mandelbrot set
 void draw_mandelbrot(Screen* screen, bool rgb) {
@@ -310,6 +312,82 @@ void test_gfx(int argc, char **argv) {
 }
 #pragma GCC diagnostic pop
 
+//blit src onto dest repeatedly and report fill rate in megapixels per second
+static void bench_blit(char* name, ca_layer* dest, ca_layer* src, int iterations) {
+	uint32_t start = time();
+	for (int i = 0; i < iterations; i++) {
+		blit_layer(dest, src, point_zero());
+	}
+	uint32_t elapsed = MAX(time() - start, 1u);
+
+	uint32_t pixels = src->size.width * src->size.height * iterations;
+	//pixels per ms is thousands of pixels per second
+	uint32_t kpps = pixels / elapsed;
+	printf("%s: %d.%d MP/s (%d ms)\n", name, kpps / 1000, (kpps % 1000) / 100, elapsed);
+}
+
+//rasterize filled primitives repeatedly and report how long each kind took
+static void bench_shapes(ca_layer* dest, int iterations) {
+	Size size = dest->size;
+	Coordinate center = point_make(size.width / 2, size.height / 2);
+
+	uint32_t start = time();
+	for (int i = 0; i < iterations; i++) {
+		for (int radius = size.height / 2; radius > 0; radius -= 4) {
+			draw_circle(dest, circle_make(center, radius), color_make(radius, i, 0), THICKNESS_FILLED);
+		}
+	}
+	uint32_t circle_ms = time() - start;
+
+	start = time();
+	for (int i = 0; i < iterations; i++) {
+		for (int inset = 0; inset < size.height / 2; inset += 4) {
+			Triangle t = triangle_make(point_make(center.x, inset),
+						   point_make(inset, size.height - inset),
+						   point_make(size.width - inset, size.height - inset));
+			draw_triangle(dest, t, color_make(inset, i, 0), THICKNESS_FILLED);
+		}
+	}
+	uint32_t triangle_ms = time() - start;
+
+	printf("filled circles: %d ms, filled triangles: %d ms\n", circle_ms, triangle_ms);
+}
+
+//compositing fill rate with off-screen layers the size of an xserv desktop
+void bench_gfx() {
+	const int iterations = 20;
+	Size size = size_make(1024, 768);
+
+	ca_layer* dest = create_layer(size);
+	ca_layer* opaque = create_layer(size);
+	ca_layer* translucent = create_layer_format(size, PIXEL_FORMAT_ARGB8888);
+
+	//gradient of coverage so every alpha value is exercised
+	for (int y = 0; y < size.height; y++) {
+		uint32_t* row = layer_row(translucent, y);
+		for (int x = 0; x < size.width; x++) {
+			row[x] = pixel_pack_premultiplied(color_make(x, y, x ^ y), x & 0xFF);
+		}
+	}
+	opaque->ops->fill_span(opaque->raw, pixel_pack(color_make(30, 120, 200)), size.width * size.height);
+	dest->ops->fill_span(dest->raw, pixel_pack(color_make(200, 200, 200)), size.width * size.height);
+
+	printf("blending %dx%d layers, %d iterations, %s kernels\n", size.width, size.height, iterations, fpu_sse2_enabled() ? "SSE2" : "scalar");
+
+	bench_blit("opaque copy", dest, opaque, iterations);
+	opaque->alpha = 0.5;
+	bench_blit("layer opacity 0.5", dest, opaque, iterations);
+	bench_blit("per-pixel alpha", dest, translucent, iterations);
+	translucent->alpha = 0.5;
+	bench_blit("per-pixel alpha, opacity 0.5", dest, translucent, iterations);
+
+	bench_shapes(dest, iterations);
+
+	layer_teardown(dest);
+	layer_teardown(opaque);
+	layer_teardown(translucent);
+}
+
 void test_xserv(Screen* vesa_screen) {
 	Window* image_viewer = create_window(rect_make(point_make(400, 50), size_make(512, 512)));
 	image_viewer->title = "Image Viewer";
@@ -7,6 +7,7 @@ void draw_mandelbrot(Screen* screen, bool rgb);
 void draw_burning_ship(Screen* screen, bool rgb);
 void draw_julia(Screen* screen, bool rgb);
 void test_gfx();
+void bench_gfx();
 void test_xserv(Screen* screen);
 
 #endif
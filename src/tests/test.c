@@ -1,9 +1,15 @@
 #include "test.h"
 #include <std/std.h>
+#include <std/math.h>
 #include <kernel/drivers/terminal/terminal.h>
 #include <kernel/drivers/vesa/vesa.h>
 #include <kernel/drivers/rtc/clock.h>
 #include <crypto/crypto.h>
+#include <kernel/util/paging/paging.h>
+#include <std/timer.h>
+#include <gfx/lib/raster.h>
+#include <kernel/util/fpu/fpu.h>
+#include <kernel/util/vfs/initrd.h>
 
 void test_colors() {
 	printf_info("Testing colors...");
@@ -43,8 +49,9 @@ void test_heap() {
 	uint32_t* a = (uint32_t*)kmalloc(8);
 	uint32_t* b = (uint32_t*)kmalloc(8);
 	printf_dbg("a: %x, b: %x", a, b);
-	kfree(a);
+	//small objects come from a slab freelist, which hands back the most recently freed object first
 	kfree(b);
+	kfree(a);
 
 	uint32_t* c = (uint32_t*)kmalloc(12);
 	printf_dbg("c: %x", c);
@@ -75,6 +82,201 @@ void test_malloc() {
 	printf_info("Malloc test passed");
 }
 
+void test_slab() {
+	printf_info("Testing slab allocator...");
+
+	const int count = 512;
+	uint32_t** objs = (uint32_t**)kmalloc(sizeof(uint32_t*) * count);
+
+	//allocate across every size class and stamp each object with its index
+	for (int i = 0; i < count; i++) {
+		uint32_t size = 16 << (i % 8);
+		objs[i] = (uint32_t*)kmalloc(size);
+		objs[i][0] = i;
+		objs[i][(size / sizeof(uint32_t)) - 1] = i;
+	}
+
+	//neighbouring objects must not have trampled each other
+	for (int i = 0; i < count; i++) {
+		uint32_t size = 16 << (i % 8);
+		if (objs[i][0] != (uint32_t)i || objs[i][(size / sizeof(uint32_t)) - 1] != (uint32_t)i) {
+			printf_err("Slab test failed, object %d at %x was corrupted", i, objs[i]);
+			return;
+		}
+		if (ksize(objs[i]) < size) {
+			printf_err("Slab test failed, object %d reported size %d (wanted %d)", i, ksize(objs[i]), size);
+			return;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		kfree(objs[i]);
+	}
+
+	//most recently freed 16 byte object should be handed straight back out
+	uint32_t* expected = objs[count - 8];
+	kfree(objs);
+	uint32_t* again = (uint32_t*)kmalloc(16);
+	kfree(again);
+	if (again != expected) {
+		printf_err("Slab test failed, expected %x to be reused (got %x)", expected, again);
+		return;
+	}
+	printf_info("Slab test passed");
+}
+
+void test_heap_coalesce() {
+	printf_info("Testing heap coalescing...");
+
+	//large enough to skip the slabs and go to the hole allocator
+	uint32_t* a = (uint32_t*)kmalloc(0x4000);
+	uint32_t* b = (uint32_t*)kmalloc(0x4000);
+	uint32_t* c = (uint32_t*)kmalloc(0x4000);
+
+	//freeing a then b should leave a single hole spanning both
+	kfree(a);
+	kfree(b);
+	uint32_t* d = (uint32_t*)kmalloc(0x8000);
+	if (d != a) {
+		printf_err("Heap coalesce test failed, expected %x to be reused (got %x)", a, d);
+		kfree(c);
+		kfree(d);
+		return;
+	}
+
+	uint32_t* e = (uint32_t*)kmalloc_a(0x1000);
+	if ((uint32_t)e & 0xFFF) {
+		printf_err("Heap coalesce test failed, %x was not page aligned", e);
+	}
+	kfree(e);
+	kfree(c);
+	kfree(d);
+	printf_info("Heap coalesce test passed");
+}
+
+void test_frames() {
+	printf_info("Testing frame allocator...");
+
+	//a 64kb run should come back naturally aligned
+	uint32_t run = alloc_contiguous(4);
+	if (!run || run & ((0x1000 << 4) - 1)) {
+		printf_err("Frame test failed, run %x was not aligned to its size", run);
+		return;
+	}
+	//once freed, the run should merge back together and be handed out again
+	free_contiguous(run, 4);
+	uint32_t again = alloc_contiguous(4);
+	free_contiguous(again, 4);
+	if (again != run) {
+		printf_err("Frame test failed, expected run %x to be reused (got %x)", run, again);
+		return;
+	}
+	printf_info("Frame test passed");
+}
+
+void test_cow() {
+	printf_info("Testing copy-on-write...");
+
+	//map a scratch page outside of the kernel's tables so it gets shared on clone
+	extern page_directory_t* current_directory;
+	uint32_t addr = 0xD0000000;
+	uint32_t table_idx = addr / 0x1000 / 1024;
+	bool had_table = current_directory->tables[table_idx] != NULL;
+	page_t* page = get_page(addr, 1, current_directory);
+	alloc_frame(page, 0, 1);
+	*(uint32_t*)addr = 0xC0FFEE;
+
+	page_directory_t* clone = clone_directory(current_directory);
+	page_t* clone_page = get_page(addr, 0, clone);
+	bool passed = false;
+	uint32_t copied = cow_stats().pages_copied;
+	if (clone_page->frame != page->frame) {
+		printf_err("COW test failed, clone didn't share frame %x", page->frame);
+	}
+	else {
+		//writing should give us our own copy and leave the clone's frame alone
+		*(uint32_t*)addr = 0xBEEF;
+		if (clone_page->frame == page->frame || cow_stats().pages_copied != copied + 1) {
+			printf_err("COW test failed, write to %x didn't copy frame %x", addr, clone_page->frame);
+		}
+		else {
+			passed = true;
+		}
+	}
+
+	free_directory(clone);
+	free_frame(page);
+	page->present = 0;
+	//drop the table we made for the scratch page too, or every later fork would clone it
+	if (!had_table) {
+		kfree(current_directory->tables[table_idx]);
+		current_directory->tables[table_idx] = NULL;
+		current_directory->tablesPhysical[table_idx] = 0;
+	}
+	asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+
+	if (passed) {
+		printf_info("COW test passed");
+	}
+}
+
+void test_demand_paging() {
+	printf_info("Testing demand paging...");
+
+	//borrow some kernel heap address space far past the end of the heap
+	uint32_t addr = 0xCF000000;
+	vmem_reserve(addr, 0x2000, 0, 1);
+
+	uint32_t faults = demand_fault_count();
+	uint32_t* ptr = (uint32_t*)(addr + 0x1000);
+	bool zeroed = (*ptr == 0);
+	*ptr = 0xC0FFEE;
+	uint32_t taken = demand_fault_count() - faults;
+	vmem_release(addr, 0x2000);
+
+	if (!zeroed) {
+		printf_err("Demand paging test failed, new page at %x wasn't zeroed", ptr);
+		return;
+	}
+	if (taken != 1) {
+		printf_err("Demand paging test failed, expected 1 fault touching %x (got %d)", ptr, taken);
+		return;
+	}
+	printf_info("Demand paging test passed");
+}
+
+static int timer_fired[3];
+static int timer_fire_count;
+
+static void test_timer_callback(void* context) {
+	if (timer_fire_count < 3) {
+		timer_fired[timer_fire_count++] = (int)context;
+	}
+}
+
+void test_timer() {
+	printf_info("Testing timer callbacks...");
+
+	//added out of order, should fire in order of their deadlines
+	timer_fire_count = 0;
+	add_callback((void*)test_timer_callback, 30, false, (void*)30);
+	add_callback((void*)test_timer_callback, 10, false, (void*)10);
+	add_callback((void*)test_timer_callback, 20, false, (void*)20);
+	sleep(50);
+
+	if (timer_fire_count != 3) {
+		printf_err("Timer test failed, expected 3 callbacks to fire (got %d)", timer_fire_count);
+		return;
+	}
+	for (int i = 0; i < 3; i++) {
+		if (timer_fired[i] != (i + 1) * 10) {
+			printf_err("Timer test failed, callback %d fired in position %d", timer_fired[i], i);
+			return;
+		}
+	}
+	printf_info("Timer test passed");
+}
+
 void test_printf() {
 	printf_info("Testing printf...");
 	printf_info("int: %d | hex: %x | char: %c | str: %s | float: %f | %%", 126, 0x14B7, 'q', "test", 3.1415926);
@@ -104,3 +306,152 @@ void test_crypto() {
 	printf_info("Testing AES...");
 	printf_info("AES test %s", aes_test() ? "passed":"failed");
 }
+
+void test_blend() {
+	printf_info("Testing alpha blending...");
+
+	//every alpha with a spread of premultiplied colors, over a spread of backgrounds
+	//odd count leaves a tail for the scalar cleanup loop of vectorized kernels
+	#define BLEND_TEST_COUNT 255
+	uint32_t src[BLEND_TEST_COUNT];
+	uint32_t dest[BLEND_TEST_COUNT];
+	uint32_t expected[BLEND_TEST_COUNT];
+	for (int i = 0; i < BLEND_TEST_COUNT; i++) {
+		uint32_t a = i;
+		src[i] = (a << 24) | (((a * 7) % (a + 1)) << 16) | (((a * 3) % (a + 1)) << 8) | (a / 2);
+		dest[i] = ((i * 37) & 0xFF) << 16 | ((i * 91) & 0xFF) << 8 | ((255 - i) & 0xFF);
+	}
+
+	pixel_format argb = pixel_format_make(PIXEL_FORMAT_ARGB8888);
+	const raster_ops* scalar = raster_ops_scalar(pixel_format_make(PIXEL_FORMAT_XRGB8888));
+	const raster_ops* fast = raster_ops_for(pixel_format_make(PIXEL_FORMAT_XRGB8888));
+
+	uint32_t opacities[] = {256, 128, 1, 0};
+	for (uint32_t o = 0; o < sizeof(opacities) / sizeof(opacities[0]); o++) {
+		uint32_t opacity = opacities[o];
+		memcpy(expected, dest, sizeof(dest));
+		scalar->blend_span((uint8_t*)expected, src, BLEND_TEST_COUNT, opacity, 0);
+
+		for (int i = 0; i < BLEND_TEST_COUNT; i++) {
+			//compare against straightforward per-channel math
+			uint32_t sa = ((src[i] >> 24) * opacity) >> 8;
+			for (int c = 0; c < 24; c += 8) {
+				uint32_t sc = (((src[i] >> c) & 0xFF) * opacity) >> 8;
+				uint32_t dc = (dest[i] >> c) & 0xFF;
+				uint32_t want = sc + ((dc * (255 - sa)) + 127) / 255;
+				uint32_t got = (expected[i] >> c) & 0xFF;
+				if (got != want) {
+					printf_err("Blend test failed, pixel %d channel %d opacity %d: expected %d, got %d", i, c / 8, opacity, want, got);
+					return;
+				}
+			}
+			if (expected[i] >> 24) {
+				printf_err("Blend test failed, pixel %d wrote alpha into XRGB layer", i);
+				return;
+			}
+		}
+
+		uint32_t out[BLEND_TEST_COUNT];
+		memcpy(out, dest, sizeof(dest));
+		fast->blend_span((uint8_t*)out, src, BLEND_TEST_COUNT, opacity, 0);
+		if (memcmp(out, expected, sizeof(out))) {
+			printf_err("Blend test failed, %s kernel differs from scalar at opacity %d", fpu_sse2_enabled() ? "SSE2" : "default", opacity);
+			return;
+		}
+	}
+
+	//opaque XRGB source replaces dest
+	uint32_t out[BLEND_TEST_COUNT];
+	memcpy(out, dest, sizeof(dest));
+	raster_ops_for(argb)->blend_span((uint8_t*)out, dest, BLEND_TEST_COUNT, 256, 0xFF000000);
+	for (int i = 0; i < BLEND_TEST_COUNT; i++) {
+		if (out[i] != (dest[i] | 0xFF000000)) {
+			printf_err("Blend test failed, opaque pixel %d was modified (%x -> %x)", i, dest[i], out[i]);
+			return;
+		}
+	}
+	printf_info("Blend test passed (%s)", fpu_sse2_enabled() ? "SSE2" : "scalar");
+}
+
+//checksum of node's contents, read chunk bytes at a time
+static uint32_t initrd_checksum(fs_node_t* node, uint8_t* buf, uint32_t chunk) {
+	uint32_t sum = 0;
+	for (uint32_t off = 0; off < node->length; off += chunk) {
+		uint32_t len = read_fs(node, off, chunk, buf);
+		for (uint32_t i = 0; i < len; i++) {
+			sum = (sum * 31) + buf[i];
+		}
+	}
+	return sum;
+}
+
+//whole blocks are decoded straight into the caller's buffer, anything smaller goes through the block cache
+//reading every file both ways must give the same bytes
+#define INITRD_TEST_CHUNK (16 * 1024)
+#define INITRD_TEST_SMALL_CHUNK 1000
+
+//reads every file under dir in chunk sized pieces
+static void initrd_read_tree(fs_node_t* dir, uint8_t* buf, uint32_t chunk) {
+	struct dirent* ent;
+	for (int i = 0; (ent = readdir_fs(dir, i)); i++) {
+		fs_node_t* node = finddir_fs(dir, ent->name);
+		if ((node->flags & 0x7) == FS_DIRECTORY) {
+			initrd_read_tree(node, buf, chunk);
+			continue;
+		}
+		if ((node->flags & 0x7) != FS_FILE) continue;
+		for (uint32_t off = 0; off < node->length; off += chunk) {
+			read_fs(node, off, chunk, buf);
+		}
+	}
+}
+
+//checks every file under dir reads the same in whole blocks and through the block cache
+static bool initrd_check_tree(fs_node_t* dir, uint8_t* buf) {
+	struct dirent* ent;
+	for (int i = 0; (ent = readdir_fs(dir, i)); i++) {
+		fs_node_t* node = finddir_fs(dir, ent->name);
+		if ((node->flags & 0x7) == FS_DIRECTORY) {
+			if (!initrd_check_tree(node, buf)) return false;
+			continue;
+		}
+		if ((node->flags & 0x7) != FS_FILE) continue;
+		uint32_t bulk = initrd_checksum(node, buf, INITRD_TEST_CHUNK);
+		uint32_t partial = initrd_checksum(node, buf, INITRD_TEST_SMALL_CHUNK);
+		if (bulk != partial) {
+			printf_err("initrd test failed, %s reads differently through the block cache", node->name);
+			return false;
+		}
+	}
+	return true;
+}
+
+void test_initrd() {
+	printf_info("Testing initrd...");
+
+	uint8_t* buf = kmalloc(INITRD_TEST_CHUNK);
+
+	initrd_stats_t before;
+	initrd_stats(&before);
+
+	//time bulk reads on their own, so checksumming doesn't count against decode throughput
+	uint32_t start = time();
+	initrd_read_tree(fs_root, buf, INITRD_TEST_CHUNK);
+	uint32_t elapsed = MAX(time() - start, 1u);
+
+	initrd_stats_t after;
+	initrd_stats(&after);
+
+	bool passed = initrd_check_tree(fs_root, buf);
+	kfree(buf);
+	if (!passed) return;
+
+	printf_info("initrd: %d of %d files compressed, %d bytes stored as %d (%d%%)", after.compressed_files, after.files, after.length, after.stored_length, (after.stored_length / MAX(after.length / 100, 1u)));
+	uint32_t decoded = after.bytes_decoded - before.bytes_decoded;
+	if (decoded) {
+		//bytes per ms is thousands of bytes per second
+		uint32_t kbps = decoded / elapsed;
+		printf_info("initrd: decoded %d bytes in %d ms, %d.%d MB/s", decoded, elapsed, kbps / 1000, (kbps % 1000) / 100);
+	}
+	printf_info("initrd test passed");
+}
@@ -10,6 +10,14 @@ void test_heap();
 void test_printf();
 void test_time_unique();
 void test_malloc();
+void test_slab();
+void test_heap_coalesce();
+void test_frames();
+void test_cow();
+void test_demand_paging();
+void test_timer();
 void test_crypto();
+void test_blend();
+void test_initrd();
 
 #endif
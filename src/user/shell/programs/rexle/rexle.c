@@ -3,6 +3,7 @@
 #include <gfx/lib/view.h>
 #include <gfx/lib/shapes.h>
 #include <gfx/lib/rect.h>
+#include <gfx/lib/surface.h>
 #include <stdint.h>
 #include <std/std.h>
 #include <std/math.h>
@@ -14,6 +15,7 @@
 #include <kernel/drivers/rtc/clock.h>
 #include <kernel/drivers/vesa/vesa.h>
 #include <kernel/drivers/kb/kb.h>
+#include <kernel/util/vfs/fs.h>
 #include "map2.h"
 
 typedef enum {
@@ -34,237 +36,474 @@ typedef enum {
 	WALL_WHITE	= 14,
 } WALL_TYPE;
 
+//16.16 fixed point used by the ray caster's inner loops
+#define FIX_SHIFT 16
+#define FIX_ONE (1 << FIX_SHIFT)
+//side distance step for rays (nearly) parallel to an axis
+//large enough that the ray never crosses that axis inside the map, small enough not to overflow while stepping
+#define FIX_MAX_DELTA (1 << 24)
+
+//fly-through benchmark length and the fixed step it advances the camera by each frame
+#define BENCH_FRAMES 720
+#define BENCH_MOVE_SPEED 0.05
+#define BENCH_ROT_SPEED (2 * M_PI / 240)
+
+//fsgen prepares up to this many mip levels for images in the textures directory
+//levels missing from a texture's file are built when it's loaded
+#define REXLE_MIP_LEVELS 4
+#define REXLE_MIP_MIN_SIZE 8
+#define TEXTURE_DIR "textures/"
+
+#define CEILING_COLOR color_make(130, 40, 100)
+#define FLOOR_COLOR color_make(135, 150, 200)
+
+typedef struct rexle_mip {
+	int width;
+	int height;
+	//texels stored column major in the back buffer's pixel format, so a wall slice is one contiguous read
+	//shade[1] is the darkened copy for walls facing north/south
+	uint32_t* shade[2];
+} rexle_mip;
+
+typedef struct rexle_texture {
+	int levels;
+	//each level is half the size of the one before, so distant walls don't skip over most of their texels
+	rexle_mip mip[REXLE_MIP_LEVELS];
+} rexle_texture;
+
+//per-column ray parameters
+//camera_x depends only on the screen width, the rest are rebuilt only when the camera rotates
+typedef struct ray_table {
+	int columns;
+	double* camera_x;
+	int32_t* dir_x;
+	int32_t* dir_y;
+	int32_t* delta_x; //distance along the ray between successive x grid lines
+	int32_t* delta_y; //distance along the ray between successive y grid lines
+} ray_table;
+
+typedef struct camera {
+	Vec2d pos;
+	Vec2d dir; //direction vector
+	Vec2d plane; //2d raycaster version of camera plane
+} camera;
+
+static const char* texture_files[] = {
+	"purplestone.bmp",
+	"bluestone.bmp",
+	"colorstone.bmp",
+	"redbrick.bmp",
+	"eagle.bmp",
+	"mossy.bmp",
+};
+#define TEXTURE_COUNT (int)(sizeof(texture_files) / sizeof(texture_files[0]))
+
 extern void draw_label(ca_layer* dest, Label* label);
-void rexle_int();
+void rexle_int(bool bench);
 
 void rexle() {
 	if (!fork("rexle")) {
-		rexle_int();
+		rexle_int(false);
 		_kill();
 	}
 }
 
-void rexle_int() {
+void rexle_bench() {
+	if (!fork("rexle")) {
+		rexle_int(true);
+		_kill();
+	}
+}
+
+static inline int32_t fix_mul(int32_t a, int32_t b) {
+	return (int32_t)(((int64_t)a * b) >> FIX_SHIFT);
+}
+
+static inline int32_t fix_from_double(double d) {
+	return (int32_t)(d * FIX_ONE);
+}
+
+//halving every channel at once is a shift with the bits that crossed channels masked off
+//matches the dark variant fsgen writes
+static inline uint32_t texel_darken(uint32_t px) {
+	return (px >> 1) & 0x7F7F7F;
+}
+
+static void mip_alloc(rexle_mip* mip, int width, int height) {
+	mip->width = width;
+	mip->height = height;
+	mip->shade[0] = kmalloc(width * height * sizeof(uint32_t));
+	mip->shade[1] = kmalloc(width * height * sizeof(uint32_t));
+}
+
+//fill level from rows of XRGB8888 texels, which is what the back buffer holds too
+//if dark is NULL the darkened copy is derived from rows
+static void mip_fill(rexle_mip* mip, const uint8_t* rows, const uint8_t* dark, uint32_t pitch) {
+	for (int y = 0; y < mip->height; y++) {
+		const uint32_t* row = (const uint32_t*)(rows + y * pitch);
+		const uint32_t* dark_row = dark ? (const uint32_t*)(dark + y * pitch) : NULL;
+		for (int x = 0; x < mip->width; x++) {
+			mip->shade[0][x * mip->height + y] = row[x];
+			mip->shade[1][x * mip->height + y] = dark_row ? dark_row[x] : texel_darken(row[x]);
+		}
+	}
+}
+
+//half size copy of src, each texel the rounded average of a 2x2 block, the same filter fsgen uses
+static void mip_downsample(rexle_mip* dest, rexle_mip* src) {
+	mip_alloc(dest, src->width / 2, src->height / 2);
+	for (int x = 0; x < dest->width; x++) {
+		const uint32_t* col0 = src->shade[0] + (x * 2) * src->height;
+		const uint32_t* col1 = col0 + src->height;
+		for (int y = 0; y < dest->height; y++) {
+			uint32_t a = col0[y * 2], b = col0[y * 2 + 1], c = col1[y * 2], d = col1[y * 2 + 1];
+			uint32_t out = 0;
+			for (int shift = 0; shift < 24; shift += 8) {
+				uint32_t sum = 2 + ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+				out |= (sum >> 2) << shift;
+			}
+			dest->shade[0][x * dest->height + y] = out;
+			dest->shade[1][x * dest->height + y] = texel_darken(out);
+		}
+	}
+}
+
+//read every level a surface made by fsgen has
+static void texture_load_surface(rexle_texture* tex, const uint8_t* data, uint32_t length) {
+	for (int level = 0; level < REXLE_MIP_LEVELS; level++) {
+		const surface_variant* normal = surface_find_variant(data, length, level, SURFACE_SHADE_NORMAL);
+		if (!normal) break;
+		const surface_variant* dark = surface_find_variant(data, length, level, SURFACE_SHADE_DARK);
+		//both shades are read with the same pitch
+		if (dark && (dark->width != normal->width || dark->height != normal->height || dark->pitch != normal->pitch)) {
+			dark = NULL;
+		}
+
+		rexle_mip* mip = &tex->mip[level];
+		mip_alloc(mip, normal->width, normal->height);
+		mip_fill(mip, data + normal->offset, dark ? data + dark->offset : NULL, normal->pitch);
+		tex->levels++;
+	}
+}
+
+static void texture_load(rexle_texture* tex, const char* filename) {
+	char path[64];
+	strcpy(path, TEXTURE_DIR);
+	strcat(path, filename);
+	memset(tex, 0, sizeof(rexle_texture));
+
+	//surfaces fsgen prepared can be used as they are
+	fs_node_t* file = lookup_fs(fs_root, path);
+	if (file) {
+		bool copied;
+		uint8_t* data = load_fs(file, &copied);
+		if (data) {
+			texture_load_surface(tex, data, file->length);
+			if (copied) kfree(data);
+		}
+	}
+
+	//anything else goes through the bmp loader
+	if (!tex->levels && file) {
+		Bmp* bmp = load_bmp(rect_make(point_zero(), size_make(100, 100)), path);
+		if (bmp) {
+			ca_layer* layer = bmp->layer;
+			mip_alloc(&tex->mip[0], layer->size.width, layer->size.height);
+			mip_fill(&tex->mip[0], layer->raw, NULL, layer->size.width * sizeof(uint32_t));
+			tex->levels = 1;
+			bmp_teardown(bmp);
+		}
+	}
+
+	//don't take rexle down over a missing texture, draw its walls a flat gray
+	if (!tex->levels) {
+		printf_err("rexle: couldn't load texture %s", path);
+		mip_alloc(&tex->mip[0], 1, 1);
+		uint32_t gray = pixel_pack(color_gray());
+		mip_fill(&tex->mip[0], (const uint8_t*)&gray, NULL, sizeof(uint32_t));
+		tex->levels = 1;
+	}
+
+	//build whichever levels the file didn't come with
+	while (tex->levels < REXLE_MIP_LEVELS) {
+		rexle_mip* last = &tex->mip[tex->levels - 1];
+		if (last->width / 2 < REXLE_MIP_MIN_SIZE || last->height / 2 < REXLE_MIP_MIN_SIZE) break;
+		mip_downsample(&tex->mip[tex->levels], last);
+		tex->levels++;
+	}
+}
+
+static void texture_teardown(rexle_texture* tex) {
+	for (int i = 0; i < tex->levels; i++) {
+		kfree(tex->mip[i].shade[0]);
+		kfree(tex->mip[i].shade[1]);
+	}
+}
+
+static void ray_table_create(ray_table* table, int columns) {
+	table->columns = columns;
+	table->camera_x = kmalloc(columns * sizeof(double));
+	table->dir_x = kmalloc(columns * sizeof(int32_t));
+	table->dir_y = kmalloc(columns * sizeof(int32_t));
+	table->delta_x = kmalloc(columns * sizeof(int32_t));
+	table->delta_y = kmalloc(columns * sizeof(int32_t));
+
+	for (int x = 0; x < columns; x++) {
+		//x in camera space
+		table->camera_x[x] = 2 * x / (double)columns - 1;
+	}
+}
+
+static void ray_table_teardown(ray_table* table) {
+	kfree(table->camera_x);
+	kfree(table->dir_x);
+	kfree(table->dir_y);
+	kfree(table->delta_x);
+	kfree(table->delta_y);
+}
+
+static inline int32_t ray_delta(double dir) {
+	if (dir < 0) dir = -dir;
+	if (dir * FIX_MAX_DELTA < FIX_ONE) return FIX_MAX_DELTA;
+	return fix_from_double(1.0 / dir);
+}
+
+//rebuild ray directions for a new camera orientation
+static void ray_table_update(ray_table* table, camera* cam) {
+	for (int x = 0; x < table->columns; x++) {
+		double dir_x = cam->dir.x + cam->plane.x * table->camera_x[x];
+		double dir_y = cam->dir.y + cam->plane.y * table->camera_x[x];
+		table->dir_x[x] = fix_from_double(dir_x);
+		table->dir_y[x] = fix_from_double(dir_y);
+		//|ray| / |ray.x| simplifies to 1 / |ray.x| since only the ratio between the axes matters
+		table->delta_x[x] = ray_delta(dir_x);
+		table->delta_y[x] = ray_delta(dir_y);
+	}
+}
+
+static void render_frame(ca_layer* dest, ray_table* table, camera* cam, rexle_texture* textures) {
+	int width = dest->size.width;
+	int height = dest->size.height;
+	uint32_t ceiling_px = pixel_pack(CEILING_COLOR);
+	uint32_t floor_px = pixel_pack(FLOOR_COLOR);
+
+	int32_t pos_x = fix_from_double(cam->pos.x);
+	int32_t pos_y = fix_from_double(cam->pos.y);
+
+	for (int x = 0; x < width; x++) {
+		int32_t ray_x = table->dir_x[x];
+		int32_t ray_y = table->dir_y[x];
+		int32_t delta_x = table->delta_x[x];
+		int32_t delta_y = table->delta_y[x];
+
+		//current position in grid
+		int map_x = pos_x >> FIX_SHIFT;
+		int map_y = pos_y >> FIX_SHIFT;
+
+		//direction to step on each axis, and length from current pos to next side
+		int step_x, step_y;
+		int32_t side_x, side_y;
+		if (ray_x < 0) {
+			step_x = -1;
+			side_x = fix_mul(pos_x - (map_x << FIX_SHIFT), delta_x);
+		}
+		else {
+			step_x = 1;
+			side_x = fix_mul(((map_x + 1) << FIX_SHIFT) - pos_x, delta_x);
+		}
+		if (ray_y < 0) {
+			step_y = -1;
+			side_y = fix_mul(pos_y - (map_y << FIX_SHIFT), delta_y);
+		}
+		else {
+			step_y = 1;
+			side_y = fix_mul(((map_y + 1) << FIX_SHIFT) - pos_y, delta_y);
+		}
+
+		//DDA
+		int side;
+		while (1) {
+			//jump to next map square, OR in each direction
+			if (side_x < side_y) {
+				side_x += delta_x;
+				map_x += step_x;
+				side = 0;
+			}
+			else {
+				side_y += delta_y;
+				map_y += step_y;
+				side = 1;
+			}
+			if (world[map_x][map_y]) break;
+		}
+
+		//distance projected on camera direction is the side distance before the final step
+		int32_t perp_wall_dist = side ? side_y - delta_y : side_x - delta_x;
+		perp_wall_dist = MAX(perp_wall_dist, 1);
+
+		//height of line to draw
+		int line_h = (height << FIX_SHIFT) / perp_wall_dist;
+		//find lowest and heighest pixel to fill on stripe
+		int start = MAX(height / 2 - line_h / 2, 0);
+		int end = MIN(height / 2 + line_h / 2, height);
+
+		//smallest level that still has a texel for every pixel of the slice
+		rexle_texture* texture = &textures[(world[map_x][map_y] - 1) % TEXTURE_COUNT];
+		int level = 0;
+		while (level + 1 < texture->levels && line_h <= texture->mip[level + 1].height) {
+			level++;
+		}
+		rexle_mip* tex = &texture->mip[level];
+
+		//where along the wall the ray hit, as a fraction of a grid square
+		int32_t wall_x = side ? pos_x + fix_mul(perp_wall_dist, ray_x) : pos_y + fix_mul(perp_wall_dist, ray_y);
+		wall_x &= FIX_ONE - 1;
+
+		//x coordinate on texture
+		int tex_x = (wall_x * tex->width) >> FIX_SHIFT;
+		if (!side && ray_x > 0) tex_x = tex->width - tex_x - 1;
+		if (side && ray_y < 0) tex_x = tex->width - tex_x - 1;
+		const uint32_t* texels = tex->shade[side] + (tex_x * tex->height);
+
+		//texture rows advance at a constant rate down the column
+		int32_t tex_step = (tex->height << FIX_SHIFT) / MAX(line_h, 1);
+		int32_t tex_pos = (int32_t)((int64_t)(start - height / 2 + line_h / 2) * tex_step);
+		int tex_max = tex->height - 1;
+
+		uint32_t* px = layer_row(dest, 0) + x;
+		int y = 0;
+		for (; y < start; y++, px += width) {
+			*px = ceiling_px;
+		}
+		for (; y < end; y++, px += width) {
+			int tex_y = MIN(tex_pos >> FIX_SHIFT, tex_max);
+			*px = texels[tex_y];
+			tex_pos += tex_step;
+		}
+		for (; y < height; y++, px += width) {
+			*px = floor_px;
+		}
+	}
+}
+
+//move along the camera's direction, sliding along walls
+static void camera_move(camera* cam, double distance) {
+	if (world[(int)(cam->pos.x + cam->dir.x * distance)][(int)cam->pos.y] == WALL_NONE) {
+		cam->pos.x += cam->dir.x * distance;
+	}
+	if (world[(int)cam->pos.x][(int)(cam->pos.y + cam->dir.y * distance)] == WALL_NONE) {
+		cam->pos.y += cam->dir.y * distance;
+	}
+}
+
+static void camera_rotate(camera* cam, double angle) {
+	//camera and plane must both be rotated
+	double c = cos(angle);
+	double s = sin(angle);
+
+	double old_dir_x = cam->dir.x;
+	cam->dir.x = cam->dir.x * c - cam->dir.y * s;
+	cam->dir.y = old_dir_x * s + cam->dir.y * c;
+
+	double old_plane_x = cam->plane.x;
+	cam->plane.x = cam->plane.x * c - cam->plane.y * s;
+	cam->plane.y = old_plane_x * s + cam->plane.y * c;
+}
+
+void rexle_int(bool bench) {
 	//switch graphics modes
-	Screen* screen = switch_to_vesa(0x112, true);
+	Screen* screen = switch_to_vesa(vesa_pick_mode(size_make(640, 480), 0x112), true);
 	//Screen* screen = switch_to_vga();
 	Size screen_size = screen->window->frame.size;
 	
 	become_first_responder();
 
 	//initialize textures
-	array_m* textures = array_m_create(16);
-	Bmp* bmp = load_bmp(rect_make(point_make(0, 0), size_make(100, 100)), "wood.bmp");
-	array_m_insert(textures, bmp);
-	bmp = load_bmp(rect_make(point_make(0, 0), size_make(100, 100)), "bluestone.bmp");
-	array_m_insert(textures, bmp);
-	bmp = load_bmp(rect_make(point_make(0, 0), size_make(100, 100)), "colorstone.bmp");
-	array_m_insert(textures, bmp);
-	bmp = load_bmp(rect_make(point_make(0, 0), size_make(100, 100)), "redbrick.bmp");
-	array_m_insert(textures, bmp);
-	bmp = load_bmp(rect_make(point_make(0, 0), size_make(100, 100)), "eagle.bmp");
-	array_m_insert(textures, bmp);
-	bmp = load_bmp(rect_make(point_make(0, 0), size_make(100, 100)), "mossy.bmp");
-	array_m_insert(textures, bmp);
+	rexle_texture textures[TEXTURE_COUNT];
+	for (int i = 0; i < TEXTURE_COUNT; i++) {
+		texture_load(&textures[i], texture_files[i]);
+	}
+
+	ray_table rays;
+	ray_table_create(&rays, screen_size.width);
 
 	//FPS counter
 	Label* fps = create_label(rect_make(point_make(3, 3), size_make(100, 15)), "FPS Counter");
 	fps->text_color = color_black();
 	add_sublabel(screen->window->content_view, fps);
+	char fps_text[32];
 
-	double timestamp = 0; //current frame timestamp
+	double timestamp = time(); //current frame timestamp
 	double time_prev = 0; //prev frame timestamp
 
-	Vec2d pos = vec2d(22.0, 12.0); //starting position
-	Vec2d dir = vec2d(-1.01, 0.01); //direction vector
-	Vec2d plane = vec2d(0.0, 0.66); //2d raycaster version of camera plane
+	camera cam;
+	cam.pos = vec2d(22.0, 12.0); //starting position
+	cam.dir = vec2d(-1.01, 0.01);
+	cam.plane = vec2d(0.0, 0.66);
+	bool camera_rotated = true;
+
+	//fly-through timings
+	uint32_t bench_start = time();
+	uint32_t render_ms = 0;
+	uint32_t present_ms = 0;
+	uint32_t slowest_ms = 0;
+	int frames = 0;
 
 	bool running = 1;
 	while (running) {
-		for (int x = 0; x < screen_size.width; x++) {
-			//ray position + distance
-			double cam_x = 2 * x / (double)screen_size.width - 1; //x in camera space
-			Vec2d ray_pos = vec2d(pos.x, pos.y);
-			Vec2d ray_dir = vec2d(dir.x + plane.x * cam_x,
-					      dir.y + plane.y * cam_x);
-			//current position in grid
-			Vec2d map_pos = vec2d((int)(ray_pos.x), (int)(ray_pos.y));
-
-			//length from current pos to next side
-			Vec2d side_dist;
-
-			//length from one side to next
-			Vec2d delta_dist = vec2d(sqrt(1 + (ray_dir.y * ray_dir.y) / (ray_dir.x * ray_dir.x)),
-					         sqrt(1 + (ray_dir.x * ray_dir.x) / (ray_dir.y * ray_dir.y)));
-
-			//direction to step on each axis (+1/-1)
-			Vec2d step;
-
-			int hit = 0; //wall hit?
-			int side; //NS or EW wall?
-
-			//calculate step and initial side_dist
-			if (ray_dir.x < 0) {
-				step.x = -1;
-				side_dist.x = (ray_pos.x - map_pos.x) * delta_dist.x;
-			}
-			else {
-				step.x = 1;
-				side_dist.x = (map_pos.x + 1.0 - ray_pos.x) * delta_dist.x;
-			}
-			if (ray_dir.y < 0) {
-				step.y = -1;
-				side_dist.y = (ray_pos.y - map_pos.y) * delta_dist.y;
-			}
-			else {
-				step.y = 1;
-				side_dist.y = (map_pos.y + 1.0 - ray_pos.y) * delta_dist.y;
-			}
+		uint32_t frame_start = time();
 
-			//DDA
-			while (!hit) {
-				//jump to next map square, OR in each direction
-				if (side_dist.x < side_dist.y) {
-					side_dist.x += delta_dist.x;
-					map_pos.x += step.x;
-					side = 0;
-				}
-				else {
-					side_dist.y += delta_dist.y;
-					map_pos.y += step.y;
-					side = 1;
-				}
-				//did we hit a wall?
-				if (world[(int)map_pos.x][(int)map_pos.y]) hit = 1;
-			}
-
-			//calculate distance projected on camera direction
-			double perp_wall_dist;
-			if (!side) perp_wall_dist = (map_pos.x - ray_pos.x + (1 - step.x) / 2) / ray_dir.x;
-			else 	   perp_wall_dist = (map_pos.y - ray_pos.y + (1 - step.y) / 2) / ray_dir.y;
-
-			//height of line to draw
-			int line_h = (int)(screen_size.height / perp_wall_dist);
-			//find lowest and heighest pixel to fill on stripe
-			int start = -line_h / 2 + screen_size.height / 2;
-			start = MAX(start, 0);
-			int end = line_h / 2 + screen_size.height / 2;
-			if (end >= screen_size.height) end = screen_size.height - 1;
-
-			//texture rendering
-			int tex_idx = world[(int)map_pos.x][(int)map_pos.y] - 1;
-			Bmp* tex = (Bmp*)array_m_lookup(textures, tex_idx % textures->size);
-			int tex_width = tex->layer->size.width;
-			int tex_height = tex->layer->size.height;
-
-			//calculate where wall was hit
-			double wall_x;
-			if (!side) wall_x = ray_pos.y + perp_wall_dist * ray_dir.y;
-			else wall_x = ray_pos.x + perp_wall_dist * ray_dir.x;
-			wall_x -= floor(wall_x);
-
-			//x coordinate on texture
-			int tex_x = (int)(wall_x * (double)tex_width);
-			if (!side && ray_dir.x > 0) tex_x = tex_width - tex_x - 1;
-			if (side && ray_dir.y < 0) tex_x = tex_width - tex_x - 1;
-
-			//this texture was not taking up the majority of the screen
-			//we must now do perspective calculations on every pixel in this vertical line of the texture
-			for (int y = start; y < end; y++) {
-				int d = y * 256 - screen_size.height * 128 + line_h * 128;
-				int tex_y = ((d * tex_height) / line_h) / 256;
-
-				//we have x and y, find color at this point in texture
-				Coordinate tex_px = point_make(tex_x % tex_width, tex_y % tex_height);
-				
-				uint8_t* raw = (uint8_t*)(tex->layer->raw + (tex_px.y * tex_width * gfx_bpp()) + (tex_px.x * gfx_bpp()));
-				Color col;
-				col.val[0] = *raw++;
-				col.val[1] = *raw++;
-				col.val[2] = *raw++;
-
-				//swap BGR
-				uint8_t tmp = col.val[0];
-				col.val[0] = col.val[2];
-				col.val[2] = tmp;
-
-				//make color darker if far side
-				if (side) {
-					col.val[0] /= 2;
-					col.val[1] /= 2;
-					col.val[2] /= 2;
-				}
-
-				putpixel(screen->vmem, x, y, col);
-			}
-
-			//draw ceiling above this ray
-			Line ceiling = line_make(point_make(x, 0), point_make(x, start));
-			draw_line(screen->vmem, ceiling, color_make(130, 40, 100), 1);
-
-			//draw floor below the ray
-			Line floor = line_make(point_make(x, end), point_make(x, screen_size.height));
-			draw_line(screen->vmem, floor, color_make(135, 150, 200), 1);
+		if (camera_rotated) {
+			ray_table_update(&rays, &cam);
+			camera_rotated = false;
 		}
+		render_frame(screen->vmem, &rays, &cam, textures);
+		uint32_t rendered = time();
 
 		//timing
 		time_prev = timestamp;
 		timestamp = time();
-		double frame_time = (timestamp - time_prev) / 1000.0;
+		double frame_time = MAX(timestamp - time_prev, 1) / 1000.0;
 
-		//speed modifiers
-		double move_speed = frame_time * 5.0; //squares/sec
-		double rot_speed = frame_time * 3.0; //rads/sec
+		int real_fps = 1 / frame_time;
+		itoa(real_fps, fps_text);
+		strcat(fps_text, " FPS");
+		fps->text = fps_text;
+		draw_label(screen->vmem, fps);
 
-		//move forward if not blocked by wall
-		if (key_down(KEY_UP)) {
-			if (world[(int)(pos.x + dir.x * move_speed)][(int)pos.y] == WALL_NONE) {
-				pos.x += dir.x * move_speed;
-			}
-			if (world[(int)pos.x][(int)(pos.y + dir.y * move_speed)] == WALL_NONE) {
-				pos.y += dir.y * move_speed;
-			}
+		write_screen(screen);
+		uint32_t presented = time();
+
+		render_ms += rendered - frame_start;
+		present_ms += presented - rendered;
+		slowest_ms = MAX(slowest_ms, presented - frame_start);
+		frames++;
+
+		if (bench) {
+			//scripted path advances by a fixed amount per frame, so every run renders the same frames
+			camera_rotate(&cam, BENCH_ROT_SPEED);
+			camera_move(&cam, BENCH_MOVE_SPEED);
+			camera_rotated = true;
+			if (frames == BENCH_FRAMES) running = 0;
 		}
-		//move backwards if not blocked by wall
-		if (key_down(KEY_DOWN)) {
-			if (world[(int)(pos.x - dir.x * move_speed)][(int)pos.y] == WALL_NONE) {
-				pos.x -= dir.x * move_speed;
+		else {
+			//speed modifiers
+			double move_speed = frame_time * 5.0; //squares/sec
+			double rot_speed = frame_time * 3.0; //rads/sec
+
+			//move forward/backwards if not blocked by wall
+			if (key_down(KEY_UP)) camera_move(&cam, move_speed);
+			if (key_down(KEY_DOWN)) camera_move(&cam, -move_speed);
+			//rotate right/left
+			if (key_down(KEY_RIGHT)) {
+				camera_rotate(&cam, -rot_speed);
+				camera_rotated = true;
 			}
-			if (world[(int)pos.x][(int)(pos.y - dir.y * move_speed)] == WALL_NONE) {
-				pos.y -= dir.y * move_speed;
+			if (key_down(KEY_LEFT)) {
+				camera_rotate(&cam, rot_speed);
+				camera_rotated = true;
 			}
 		}
-		//rotate right
-		if (key_down(KEY_RIGHT)) {
-			//camera and plane must both be rotated
-			double old_dir_x = dir.x;
-			dir.x = dir.x * cos(-rot_speed) - dir.y * sin(-rot_speed);
-			dir.y = old_dir_x * sin(-rot_speed) + dir.y * cos(-rot_speed);
-
-			double old_plane_x = plane.x;
-			plane.x = plane.x * cos(-rot_speed) - plane.y * sin(-rot_speed);
-			plane.y = old_plane_x * sin(-rot_speed) + plane.y * cos(-rot_speed);
-		}
-		//rotate left
-		if (key_down(KEY_LEFT)) {
-			//camera and plane must both be rotated
-			double old_dir_x = dir.x;
-			dir.x = dir.x * cos(rot_speed) - dir.y * sin(rot_speed);
-			dir.y = old_dir_x * sin(rot_speed) + dir.y * cos(rot_speed);
-
-			double old_plane_x = plane.x;
-			plane.x = plane.x * cos(rot_speed) - plane.y * sin(rot_speed);
-			plane.y = old_plane_x * sin(rot_speed) + plane.y * cos(rot_speed);
-		}
-
-		int real_fps = 1 / frame_time;
-		char buf[32];
-		itoa(real_fps, (char*)&buf);
-		strcat(buf, " FPS");
-		fps->text = buf;
-		draw_label(screen->vmem, fps);
-
-		write_screen(screen);
 
 		char ch = kgetch();
 		if (ch == 'q') {
@@ -272,16 +511,20 @@ void rexle_int() {
 			break;
 		}
 	}
+	uint32_t bench_ms = MAX(time() - bench_start, 1u);
 
 	//cleanup
-	//free textures
-	for (int i = 0; i < textures->size; i++) {
-		Bmp* bmp = array_m_lookup(textures, i);
-		printf_dbg("freeing bmp [%d]%x", i, bmp);
-		bmp_teardown(bmp);
+	for (int i = 0; i < TEXTURE_COUNT; i++) {
+		texture_teardown(&textures[i]);
 	}
+	ray_table_teardown(&rays);
 	gfx_teardown(screen);
 
 	switch_to_text();
 	resign_first_responder();
+
+	if (bench) {
+		printf("rexle: %d frames in %d ms, %d FPS\n", frames, bench_ms, (frames * 1000) / bench_ms);
+		printf("rexle: avg render %d ms, avg present %d ms, slowest frame %d ms\n", render_ms / frames, present_ms / frames, slowest_ms);
+	}
 }
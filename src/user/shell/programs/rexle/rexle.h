@@ -7,6 +7,9 @@ extern "C" {
 
 void rexle();
 
+//renders a fixed fly-through path and reports frame timings
+void rexle_bench();
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 #include "shell.h"
 #include <lib/iberty/iberty.h>
 #include <std/kheap.h>
+#include <std/kslab.h>
 #include <std/memory.h>
 #include <std/printf.h>
 #include <gfx/lib/gfx.h>
@@ -264,17 +265,20 @@ void cat_command(int argc, char** argv) {
 		return;
 	}
 	char* file = argv[1];
-	fs_node_t* node = finddir_fs(current_dir, file);
+	fs_node_t* node = lookup_fs(current_dir, file);
 	if (!node) {
 		printf_err("File %s not found");
 		return;
 	}
-	uint8_t filebuf[2048];
-	memset(filebuf, 0, 2048);
-	uint32_t sz = read_fs(node, 0, 2048, filebuf);
-	for (uint32_t i = 0; i < sz; i++) {
-		terminal_putchar(filebuf[i]);
+	FILE* stream = fopen_node(node);
+	uint8_t filebuf[512];
+	uint32_t sz;
+	while ((sz = fread(filebuf, 1, sizeof(filebuf), stream))) {
+		for (uint32_t i = 0; i < sz; i++) {
+			terminal_putchar(filebuf[i]);
+		}
 	}
+	fclose(stream);
 }
 
 void hex_command(int argc, char** argv) {
@@ -283,17 +287,18 @@ void hex_command(int argc, char** argv) {
 		return;
 	}
 	char* file = argv[1];
-	fs_node_t* node = finddir_fs(current_dir, file);
+	fs_node_t* node = lookup_fs(current_dir, file);
 	if (!node) {
 		printf_err("File %s not found");
 		return;
 	}
+	FILE* stream = fopen_node(node);
 	uint8_t filebuf[8];
-	memset(filebuf, 0, 8);
-	uint32_t sz = read_fs(node, 0, 8, filebuf);
+	uint32_t sz = fread(filebuf, 1, sizeof(filebuf), stream);
 	for (uint32_t i = 0; i < sz; i++) {
 		printf("%x ", filebuf[i]);
 	}
+	fclose(stream);
 }
 
 void cd_command(int argc, char** argv) {
@@ -303,8 +308,8 @@ void cd_command(int argc, char** argv) {
 	}
 
 	char* dest = argv[1];
-	fs_node_t* new_dir = finddir_fs(current_dir, dest);
-	if (new_dir) {
+	fs_node_t* new_dir = lookup_fs(current_dir, dest);
+	if (new_dir && (new_dir->flags & 0x7) == FS_DIRECTORY) {
 		current_dir = new_dir;
 		return;
 	}
@@ -376,9 +381,12 @@ void shell_init() {
 	add_new_command("tick", "Prints current tick count from PIT", tick_command);
 	add_new_command("shutdown", "Shutdown PC", shutdown_command);
 	add_new_command("gfxtest", "Run graphics tests", test_gfx);
+	add_new_command("gfxbench", "Measure compositing fill rate and shape rasterization", bench_gfx);
 	add_new_command("startx", "Start window manager", startx_command);
 	add_new_command("rexle", "Start 3D renderer", rexle);
+	add_new_command("rexlebench", "Time a fixed fly-through of the 3D renderer", rexle_bench);
 	add_new_command("heap", "Run heap test", test_heap);
+	add_new_command("slab", "Print slab allocator statistics", slab_stats);
 	add_new_command("ls", "List contents of current directory", ls_command);
 	add_new_command("cd", "Switch to another directory", (void(*)())cd_command);
 	add_new_command("pwd", "Print working directory", pwd_command);
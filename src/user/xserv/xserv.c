@@ -16,6 +16,8 @@
 //has the screen been modified this refresh?
 static char dirtied = 0;
 static volatile Window* active_window;
+//screen whose damage region receives rects reported by views
+static Screen* damage_screen = NULL;
 
 ca_layer* layer_snapshot(ca_layer* src, Rect frame) {
 	//clip frame
@@ -33,89 +35,74 @@ ca_layer* layer_snapshot(ca_layer* src, Rect frame) {
 	ca_layer* snapshot = create_layer(frame.size);
 
 	//pointer to current row of snapshot to write to
-	uint8_t* snapshot_row = snapshot->raw;
+	uint32_t* snapshot_row = layer_row(snapshot, 0);
 	//pointer to start of row currently writing to snapshot
-	uint8_t* row_start = src->raw + (rect_min_y(frame) * src->size.width * gfx_bpp()) + (rect_min_x(frame) * gfx_bpp());
+	uint32_t* row_start = layer_row(src, rect_min_y(frame)) + rect_min_x(frame);
 
 	//copy row by row
 	for (int i = 0; i < frame.size.height; i++) {
-		memcpy(snapshot_row, row_start, frame.size.width * gfx_bpp());
+		memcpy(snapshot_row, row_start, frame.size.width * sizeof(uint32_t));
 
-		snapshot_row += (snapshot->size.width * gfx_bpp());
-		row_start += (src->size.width * gfx_bpp());
+		snapshot_row += snapshot->size.width;
+		row_start += src->size.width;
 	}
 
 	return snapshot;
 }
 
 Window* containing_window_int(Screen* screen, View* v) {
-	//find root window
-	View* view = v;
-	while (view->superview) {
-		view = view->superview;
-	}
-
-	//if (screen->window->title_view == view || screen->window->content_view == view) return screen->window
-
-	//traverse view hierarchy, find window which has view as its title or content view
-	for (int32_t i = 0; i < screen->window->subviews->size; i++) {
-		Window* window = (Window*)array_m_lookup(screen->window->subviews, i);
-
-		//if user passed a Window, check against that
-		if (window == (Window*)view) return window;
-
-		if (window->title_view == view || window->content_view == view) return window;
-		for (int32_t j = 0; j < window->subviews->size; j++) {
-			Window* subwindow = (Window*)array_m_lookup(window->subviews, j);
-			if (subwindow->title_view == view || subwindow->content_view == view) return subwindow;
-		}
-	}
+	//views track their window as they're attached
+	if (v->window) return v->window;
 	return screen->window;
 }
 
-Rect convert_rect(Rect outer, Rect inner) {
-	Rect ret;
-	ret.origin.x = inner.origin.x + outer.origin.x;
-	ret.origin.y = inner.origin.y + outer.origin.y;
-	ret.size.width = MIN(inner.size.width, outer.size.width);
-	ret.size.height = MIN(inner.size.height, outer.size.height);
-	return ret;
-}
-
-Rect convert_frame(View* view, Rect frame) {
-	if (!view) return frame;
-
-	Rect ret = convert_rect(view->frame, frame);
-	return ret;
-}
-
 Rect absolute_frame(Screen* screen, View* view) {
-	Rect ret = view->frame;
-	//find root view
-	View* v = view;
-	while (v->superview) {
-		v = v->superview;
-		ret = convert_frame(v, ret);
-	}
-
-	//find containing window
-	Window* win = containing_window_int(screen, v);
+	Window* win = containing_window_int(screen, view);
 	ASSERT(win, "couldn't find container window!");
 
-	return convert_rect(win->frame, ret);
+	Rect ret = view->window_frame;
+	ret.origin.x += win->frame.origin.x;
+	ret.origin.y += win->frame.origin.y;
+	return ret;
 }
 
 void draw_bmp(ca_layer* dest, Bmp* bmp) {
 	if (!bmp) return;
 
-	blit_layer(dest, bmp->layer, bmp->frame); 
+	blit_layer(dest, bmp->layer, bmp->frame.origin);
 
 	bmp->needs_redraw = 0;
 }
 
-void draw_label(ca_layer* dest, Label* label) {
-	if (!label) return;
+//translates damage reported by a view into screen space
+static void xserv_damage(View* view, Rect frame) {
+	Screen* screen = damage_screen;
+	if (!screen) return;
+
+	//windows are already positioned in screen space
+	if (view->window == (Window*)view) {
+		damage_add(&screen->damage, frame);
+		return;
+	}
+	//not on screen yet
+	if (!view->window) return;
+
+	//frame is relative to view's superview,
+	//and the outermost view is positioned relative to its window
+	if (view->superview) {
+		frame.origin.x += view->superview->window_frame.origin.x;
+		frame.origin.y += view->superview->window_frame.origin.y;
+	}
+	Window* win = view->window;
+	frame.origin.x += win->frame.origin.x;
+	frame.origin.y += win->frame.origin.y;
+
+	//views can't draw outside their window
+	damage_add(&screen->damage, rect_intersect(frame, win->frame));
+}
 
+//render label's text into its layer, unless the layer already holds it
+static void render_label(Label* label) {
 	View* superview = label->superview;
 	Rect frame = label->frame;
 	frame.origin = point_zero();
@@ -125,6 +112,12 @@ void draw_label(ca_layer* dest, Label* label) {
 	if (superview) {
 		background_color = superview->background_color;
 	}
+
+	//nothing about the label changed, reuse what's already rendered in its layer
+	if (label_render_cached(label, background_color)) {
+		return;
+	}
+
 	draw_rect(label->layer, rect_make(point_zero(), label->frame.size), background_color, THICKNESS_FILLED);
 
 	//actually render text
@@ -149,36 +142,40 @@ void draw_label(ca_layer* dest, Label* label) {
 
 		idx++;
 	}
+	label_render_store(label, background_color);
+}
 
+void draw_label(ca_layer* dest, Label* label) {
+	if (!label) return;
+
+	render_label(label);
 	blit_layer(dest, label->layer, label->frame.origin);
 
 	label->needs_redraw = 0;
 }
 
-void draw_view(Screen* screen, View* view) {
-	if (!view) return;
-	if (!containing_window_int(screen, view)->needs_redraw) {
-		return;
-	}
-
-	//inform subviews that we're being redrawn
-	dirtied = 1;
-
+//rebuild region of view's layer from its background and the cached layers of its contents
+static void composite_view(View* view, Rect region) {
 	//fill view with its background color
-	draw_rect(view->layer, rect_make(point_zero(), view->frame.size), view->background_color, THICKNESS_FILLED);
+	draw_rect(view->layer, region, view->background_color, THICKNESS_FILLED);
 
 	//draw any labels this view has
 	for (int i = 0; i < view->labels->size; i++) {
 		Label* label = (Label*)array_m_lookup(view->labels, i);
-		draw_label(view->layer, label);
+		if (!rect_intersects(label->frame, region)) continue;
+
+		render_label(label);
+		blit_layer_clipped(view->layer, label->layer, label->frame.origin, region);
+		label->needs_redraw = 0;
 	}
 
 	//draw any bmps this view has
 	for (int i = 0; i < view->bmps->size; i++) {
 		Bmp* bmp = (Bmp*)array_m_lookup(view->bmps, i);
-		if (bmp) {
-			draw_bmp(view->layer, bmp);
-		}
+		if (!bmp || !rect_intersects(bmp->frame, region)) continue;
+
+		blit_layer_clipped(view->layer, bmp->layer, bmp->frame.origin, region);
+		bmp->needs_redraw = 0;
 	}
 
 	/*
@@ -189,55 +186,111 @@ void draw_view(Screen* screen, View* view) {
 	}
 	*/
 
-	//draw each subview of this view
+	//composite each subview's retained layer on top
 	for (int i = 0; i < view->subviews->size; i++) {
 		View* subview = (View*)array_m_lookup(view->subviews, i);
-		draw_view(screen, subview);
+		if (!rect_intersects(subview->frame, region)) continue;
+
+		blit_layer_clipped(view->layer, subview->layer, subview->frame.origin, region);
 	}
-	view->needs_redraw = 0;
 }
 
-bool draw_window(Screen* screen, Window* window) {
-	if (!window->needs_redraw) return false;
+//bring view's layer and those of its subviews up to date
+//a view's own content is only re-rendered when it changed,
+//otherwise just the parts covered by changed subviews are recomposited
+//returns the part of view's layer which changed, in view's coordinates
+static Rect draw_view(Screen* screen, View* view) {
+	if (!view) return rect_zero();
+
+	//subviews first, so their layers are current when they're composited into this one
+	for (int i = 0; i < view->subviews->size; i++) {
+		View* subview = (View*)array_m_lookup(view->subviews, i);
+		Rect changed = draw_view(screen, subview);
+		if (rect_is_empty(changed)) continue;
+
+		changed.origin.x += subview->frame.origin.x;
+		changed.origin.y += subview->frame.origin.y;
+		view_invalidate(view, changed);
+	}
+
+	Rect region = view->dirty;
+	if (view->needs_redraw) {
+		region = rect_make(point_zero(), view->frame.size);
+	}
+	view->needs_redraw = 0;
+	view->dirty = rect_zero();
+	if (rect_is_empty(region)) return region;
 
+	//inform subviews that we're being redrawn
 	dirtied = 1;
 
-	//paint window
-	draw_rect(window->layer, rect_make(point_zero(), window->frame.size), window->border_color, window->border_width);
+	composite_view(view, region);
+	return region;
+}
 
-	//only draw a title bar if title_view exists
-	if (window->title_view) {
-		//update title label of window
-		Label* title_label = (Label*)array_m_lookup(window->title_view->labels, 0);
-		title_label->text = window->title;
-		draw_view(screen, window->title_view);
+//composite region of window's layer from its chrome and its views' retained layers
+//full redraws also repaint the chrome
+static void composite_window(Window* window, Rect region, bool full) {
+	Rect bounds = rect_make(point_zero(), window->frame.size);
+
+	//paint window
+	//twice the border width covers the gap between the border and the content view
+	if (full) {
+		draw_rect(window->layer, bounds, window->border_color, window->border_width * 2);
 	}
 
-	//only draw the content view if content_view exists
-	if (window->content_view) {
-		draw_view(screen, window->content_view);
+	if (window->title_view && rect_intersects(window->title_view->frame, region)) {
+		blit_layer_clipped(window->layer, window->title_view->layer, window->title_view->frame.origin, region);
+	}
+	if (window->content_view && rect_intersects(window->content_view->frame, region)) {
+		blit_layer_clipped(window->layer, window->content_view->layer, window->content_view->frame.origin, region);
 
 		//draw dividing border between window border and other content
 		if (window->border_width) {
 			//inner border
-			draw_rect(window->content_view->layer, rect_make(point_zero(), window->content_view->frame.size), color_gray(), window->border_width);
+			draw_rect(window->layer, window->content_view->frame, color_gray(), window->border_width);
 		}
 	}
 
-	//composite views of this window into layer
+	//draw window border
+	draw_rect(window->layer, bounds, color_black(), 1);
+}
+
+//bring window's layer up to date
+//returns the part of window's layer which changed, in window's coordinates
+Rect draw_window(Screen* screen, Window* window) {
+	Rect changed = rect_zero();
+
+	//only draw a title bar if title_view exists
 	if (window->title_view) {
-		blit_layer(window->layer, window->title_view->layer, window->title_view->frame.origin);
+		//update title label of window
+		Label* title_label = (Label*)array_m_lookup(window->title_view->labels, 0);
+		title_label->text = window->title;
+
+		Rect title = draw_view(screen, window->title_view);
+		title.origin.x += window->title_view->frame.origin.x;
+		title.origin.y += window->title_view->frame.origin.y;
+		changed = rect_union(changed, title);
 	}
+
+	//only draw the content view if content_view exists
 	if (window->content_view) {
-		blit_layer(window->layer, window->content_view->layer, window->content_view->frame.origin);
+		Rect content = draw_view(screen, window->content_view);
+		content.origin.x += window->content_view->frame.origin.x;
+		content.origin.y += window->content_view->frame.origin.y;
+		changed = rect_union(changed, content);
 	}
 
-	//draw window border
-	draw_rect(window->layer, rect_make(point_zero(), window->frame.size), color_black(), 1);
-
+	bool full = window->needs_redraw;
+	if (full) {
+		changed = rect_make(point_zero(), window->frame.size);
+	}
 	window->needs_redraw = 0;
+	if (rect_is_empty(changed)) return changed;
 
-	return true;
+	dirtied = 1;
+	composite_window(window, changed, full);
+	return changed;
 }
 
 void add_taskbar(Screen* screen) {
@@ -281,18 +334,110 @@ void add_status_bar(Screen* screen) {
 	add_subview(status_bar, border);
 }
 
-void draw_desktop(Screen* screen) {
-	//paint root desktop
-	draw_window(screen, screen->window);
-	blit_layer(screen->vmem, screen->window->layer, point_zero());
+//re-render the parts of any window which changed, and damage them
+//returns whether the root window was re-rendered
+static bool render_windows(Screen* screen) {
+	Rect root_changed = draw_window(screen, screen->window);
+	damage_add(&screen->damage, root_changed);
 
-	//paint every child window
 	for (int i = 0; i < screen->window->subviews->size; i++) {
 		Window* win = (Window*)(array_m_lookup(screen->window->subviews, i));
-		draw_window(screen, win);
-			//composite child window onto root window
-			blit_layer(screen->vmem, win->layer, win->frame.origin);
-		//}
+		Rect changed = draw_window(screen, win);
+		if (rect_is_empty(changed)) continue;
+
+		changed.origin.x += win->frame.origin.x;
+		changed.origin.y += win->frame.origin.y;
+		damage_add(&screen->damage, changed);
+	}
+	return !rect_is_empty(root_changed);
+}
+
+//most rects one window's visible part of a damaged region is split into
+//past this, occlusion stops being tracked for that region and windows beneath are drawn in full
+#define VISIBLE_MAX_RECTS 32
+//most windows composited, the root window plus its subwindows
+#define COMPOSITE_MAX_WINDOWS 65
+
+typedef struct visible_region {
+	Rect rects[VISIBLE_MAX_RECTS];
+	int count;
+} visible_region;
+
+//part of the region being composited not yet covered by an opaque window
+static visible_region uncovered;
+//part of each window which shows through, indexed in z-order with the root window at 0
+static visible_region visible[COMPOSITE_MAX_WINDOWS];
+
+static bool occlusion_culling = true;
+//pixels written to vmem and pixels damaged by the last composite, their ratio is the overdraw
+static uint32_t last_composited_pixels = 0;
+static uint32_t last_damaged_pixels = 0;
+
+static bool window_is_opaque(Window* win) {
+	return win->layer->alpha >= 1.0 && !win->layer->format.alpha_mask;
+}
+
+//remove cutting from region
+//if the pieces wouldn't fit, region is left as is, so windows below cutting are drawn anyway
+static void visible_subtract(visible_region* region, Rect cutting) {
+	Rect out[VISIBLE_MAX_RECTS];
+	int count = 0;
+	for (int i = 0; i < region->count; i++) {
+		Rect pieces[4];
+		int piece_count = rect_subtract(region->rects[i], cutting, pieces);
+		if (count + piece_count > VISIBLE_MAX_RECTS) return;
+
+		for (int j = 0; j < piece_count; j++) {
+			out[count++] = pieces[j];
+		}
+	}
+	memcpy(region->rects, out, count * sizeof(Rect));
+	region->count = count;
+}
+
+//composite region of vmem from the window layers
+//visible parts of every window are found front to back, with opaque windows hiding whatever is beneath them,
+//then drawn back to front so translucent windows still blend over what they cover
+static void composite_region(Screen* screen, Rect region) {
+	Window* root = screen->window;
+	int window_count = root->subviews->size + 1;
+	ASSERT(window_count <= COMPOSITE_MAX_WINDOWS, "too many windows to composite (%d)", window_count);
+
+	uncovered.rects[0] = region;
+	uncovered.count = 1;
+	for (int i = window_count - 1; i >= 0; i--) {
+		Window* win = i ? (Window*)array_m_lookup(root->subviews, i - 1) : root;
+		visible_region* vis = &visible[i];
+		vis->count = 0;
+
+		for (int j = 0; j < uncovered.count; j++) {
+			Rect r = rect_intersect(uncovered.rects[j], win->frame);
+			if (!rect_is_empty(r)) {
+				vis->rects[vis->count++] = r;
+			}
+		}
+		if (occlusion_culling && vis->count && window_is_opaque(win)) {
+			visible_subtract(&uncovered, win->frame);
+		}
+	}
+
+	//paint root desktop, then every child window in z-order
+	for (int i = 0; i < window_count; i++) {
+		Window* win = i ? (Window*)array_m_lookup(root->subviews, i - 1) : root;
+		visible_region* vis = &visible[i];
+		for (int j = 0; j < vis->count; j++) {
+			blit_layer_clipped(screen->vmem, win->layer, win->frame.origin, vis->rects[j]);
+			last_composited_pixels += vis->rects[j].size.width * vis->rects[j].size.height;
+		}
+	}
+}
+
+//rebuild every damaged region of vmem from the window layers
+static void composite_damage(Screen* screen) {
+	damage_region* damage = &screen->damage;
+	last_composited_pixels = 0;
+	for (int i = 0; i < damage->count; i++) {
+		composite_region(screen, damage->rects[i]);
 	}
 }
 
@@ -306,43 +451,246 @@ void desktop_setup(Screen* screen) {
 	add_taskbar(screen);
 }
 
-void draw_cursor(Screen* screen) {
-	//actual cursor bitmap
-	static Bmp* cursor = 0;
-	static bool tried_loading_cursor = false;
-	static int max_per_frame_movement = 5;
-
-	if (!tried_loading_cursor) {
-		cursor = load_bmp(rect_make(point_zero(), size_make(12, 18)), "cursor.bmp");
-		tried_loading_cursor = true;
-	}
-
-	//update cursor position
-	cursor->frame.origin = mouse_point();
+//the cursor never touches vmem
+//it is stamped straight into the framebuffer, over a saved copy of the pixels it covers
+typedef struct cursor_overlay {
+	ca_layer* image; //cursor bitmap
+	ca_layer* save_under; //framebuffer contents beneath the cursor
+	Coordinate origin; //where the cursor is stamped in the framebuffer
+	bool visible; //is the cursor currently stamped?
+} cursor_overlay;
 
-	//drawing cursor shouldn't change dirtied flag
-	//save dirtied flag, draw cursor, and restore it
-	char prev_dirtied = dirtied;
+static cursor_overlay cursor;
 
+static void cursor_setup() {
 	//we do not call add_bmp on the cursor
 	//we draw it manually to ensure it is always above all other content
-	if (cursor) {
-		draw_bmp(screen->vmem, cursor);
+	Bmp* bmp = load_bmp(rect_make(point_zero(), size_make(12, 18)), "cursor.bmp");
+	if (bmp) {
+		cursor.image = bmp->layer;
 	}
 	else {
 		//couldn't load cursor, use backup
-		draw_rect(screen->vmem, rect_make(mouse_point(), size_make(10, 12)), color_blue(), THICKNESS_FILLED);
+		cursor.image = create_layer(size_make(10, 12));
+		draw_rect(cursor.image, rect_make(point_zero(), cursor.image->size), color_blue(), THICKNESS_FILLED);
+	}
+	cursor.save_under = create_layer(cursor.image->size);
+	cursor.visible = false;
+}
+
+static Rect cursor_frame() {
+	return rect_make(cursor.origin, cursor.image->size);
+}
+
+//put back the pixels the cursor was covering
+static void cursor_hide(Screen* screen) {
+	if (!cursor.visible) return;
+
+	write_screen_layer(screen, cursor.save_under, cursor.origin);
+	cursor.visible = false;
+}
+
+static void cursor_show(Screen* screen, Coordinate origin) {
+	cursor.origin = origin;
+
+	//vmem holds exactly what the framebuffer shows minus the cursor, so save from there
+	//rather than reading back slow video memory
+	blit_layer(cursor.save_under, screen->vmem, point_make(-origin.x, -origin.y));
+	write_screen_layer(screen, cursor.image, origin);
+	cursor.visible = true;
+}
+
+//with page flipping, each page is only brought up to date when it's about to be shown,
+//so it needs every rect damaged since it was last presented rather than just this frame's
+static damage_region page_damage[2];
+//where the cursor is stamped on each page
+static Rect page_cursor[2];
+
+static void page_flip_reset(Screen* screen) {
+	for (int i = 0; i < 2; i++) {
+		damage_init(&page_damage[i], screen->vmem->size);
+		page_cursor[i] = rect_zero();
+	}
+}
+
+//bring the back page up to date, stamp the cursor onto it and flip it onto the screen
+//the cursor is restored from vmem on the page it was stamped on, so no save-under is needed
+static void present_frame_flipped(Screen* screen) {
+	damage_region* damage = &screen->damage;
+	Coordinate mouse = mouse_point();
+
+	bool moved = !cursor.visible || mouse.x != cursor.origin.x || mouse.y != cursor.origin.y;
+	if (!damage->count && !moved) return;
+
+	for (int page = 0; page < 2; page++) {
+		for (int i = 0; i < damage->count; i++) {
+			damage_add(&page_damage[page], damage->rects[i]);
+		}
+	}
+	damage_clear(damage);
+
+	int back = screen->back_page;
+	//the cursor isn't part of vmem, so wherever it's stamped on this page is out of date too
+	damage_add(&page_damage[back], page_cursor[back]);
+	for (int i = 0; i < page_damage[back].count; i++) {
+		write_screen_region(screen, page_damage[back].rects[i]);
+	}
+	damage_clear(&page_damage[back]);
+
+	cursor.origin = mouse;
+	cursor.visible = true;
+	write_screen_layer(screen, cursor.image, mouse);
+	page_cursor[back] = cursor_frame();
+
+	screen_flip(screen);
+}
+
+//push every damaged region of vmem to the framebuffer and move the cursor overlay
+//pure cursor motion only touches the cursor's old and new rects
+static void present_frame(Screen* screen) {
+	if (screen->page_count > 1) {
+		present_frame_flipped(screen);
+		return;
+	}
+
+	damage_region* damage = &screen->damage;
+	Coordinate mouse = mouse_point();
+
+	bool moved = !cursor.visible || mouse.x != cursor.origin.x || mouse.y != cursor.origin.y;
+	if (!damage->count && !moved) return;
+
+	//frames are paced by the PIT rather than by spinning on the retrace bit
+	if (moved) {
+		cursor_hide(screen);
+	}
+	else {
+		//damage flushed over the cursor would wipe out part of it
+		for (int i = 0; i < damage->count; i++) {
+			if (rect_intersects(damage->rects[i], cursor_frame())) {
+				//the flush rewrites what's under the cursor, so there's nothing to restore
+				cursor.visible = false;
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < damage->count; i++) {
+		write_screen_region(screen, damage->rects[i]);
+	}
+	damage_clear(damage);
+
+	if (!cursor.visible) {
+		cursor_show(screen, mouse);
 	}
+}
+
+static Label* fps;
 
-	dirtied = prev_dirtied;
+//target time between frames, in ms
+#define FRAME_INTERVAL 16
+//frame times kept for percentiles
+#define FRAME_HISTORY 128
+
+//time from the start of rendering to the end of presentation for recent frames, in ms
+static uint32_t frame_times[FRAME_HISTORY];
+static int frame_time_count = 0;
+static int frame_time_next = 0;
+//a frame time was recorded which isn't on screen yet
+static bool frame_stats_pending = false;
+
+static void record_frame_time(uint32_t ms) {
+	frame_times[frame_time_next] = ms;
+	frame_time_next = (frame_time_next + 1) % FRAME_HISTORY;
+	frame_time_count = MIN(frame_time_count + 1, FRAME_HISTORY);
+	frame_stats_pending = true;
+}
+
+//fills p50, p95 and p99 of the recorded frame times
+static void frame_time_percentiles(uint32_t* p50, uint32_t* p95, uint32_t* p99) {
+	*p50 = *p95 = *p99 = 0;
+	if (!frame_time_count) return;
+
+	//history is small, an insertion sort is plenty
+	uint32_t sorted[FRAME_HISTORY];
+	for (int i = 0; i < frame_time_count; i++) {
+		uint32_t val = frame_times[i];
+		int j = i;
+		for (; j > 0 && sorted[j - 1] > val; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = val;
+	}
+	*p50 = sorted[((frame_time_count - 1) * 50) / 100];
+	*p95 = sorted[((frame_time_count - 1) * 95) / 100];
+	*p99 = sorted[((frame_time_count - 1) * 99) / 100];
+}
+
+static void draw_frame_stats(Screen* screen, bool root_redrawn) {
+	//re-rendering the root window paints over the stats, so they always need to be redrawn then
+	static char last_dirtied = -1;
+	static char last_text[64];
+
+	//draw rect to indicate whether the screen was dirtied this frame
+	//red indicates dirtied, green indicates clean
+	if (root_redrawn || dirtied != last_dirtied) {
+		Rect dirtied_indicator = rect_make(point_make(0, screen->window->size.height - 25), size_make(25, 25));
+		draw_rect(screen->window->layer, dirtied_indicator, (dirtied ? color_red() : color_green()), THICKNESS_FILLED);
+		damage_add(&screen->damage, dirtied_indicator);
+		last_dirtied = dirtied;
+	}
+
+	//update frame time tracker
+	//label holds onto its text, so keep it out of the stack
+	static char buf[64];
+	char num[16];
+	uint32_t p50, p95, p99;
+	frame_time_percentiles(&p50, &p95, &p99);
+	frame_stats_pending = false;
+
+	strcpy(buf, "p50/95/99 ");
+	itoa(p50, (char*)&num);
+	strcat(buf, num);
+	strcat(buf, "/");
+	itoa(p95, (char*)&num);
+	strcat(buf, num);
+	strcat(buf, "/");
+	itoa(p99, (char*)&num);
+	strcat(buf, num);
+	strcat(buf, " ms, ");
+	itoa(last_damaged_pixels, (char*)&num);
+	strcat(buf, num);
+	strcat(buf, " px damaged, ");
+
+	//how many times each damaged pixel was written while compositing, 1.00x is no overdraw
+	uint32_t overdraw = 100;
+	if (last_damaged_pixels) {
+		overdraw = ((double)last_composited_pixels / last_damaged_pixels) * 100;
+	}
+	itoa(overdraw / 100, (char*)&num);
+	strcat(buf, num);
+	strcat(buf, (overdraw % 100) < 10 ? ".0" : ".");
+	itoa(overdraw % 100, (char*)&num);
+	strcat(buf, num);
+	strcat(buf, "x overdraw");
+
+	//only repaint the label when its text changes
+	if (!root_redrawn && !strcmp(buf, last_text)) return;
+	strcpy(last_text, buf);
+
+	fps->text = buf;
+	draw_label(screen->window->layer, fps);
+	damage_add(&screen->damage, fps->frame);
 }
 
 char xserv_draw(Screen* screen) {
 	screen->finished_drawing = 0;
 
 	dirtied = 0;
-	draw_desktop(screen);
-	draw_cursor(screen);
+	bool root_redrawn = render_windows(screen);
+	draw_frame_stats(screen, root_redrawn);
+
+	last_damaged_pixels = damage_pixels(&screen->damage);
+	composite_damage(screen);
 
 	screen->finished_drawing = 1;
 
@@ -374,8 +722,8 @@ static void set_active_window(Screen* screen, Window* grabbed_window) {
 		else {
 			color = color_make(50, 122, 40);
 		}
+		//only the title bar changes, the window recomposites it over its retained content
 		set_background_color(win->title_view, color);
-		mark_needs_redraw((View*)win);
 	}
 
 }
@@ -422,14 +770,32 @@ static void process_mouse_events(Screen* screen) {
 	last_mouse_pos = p;
 }
 
+//discard view's retained layer and those of its subviews
+static void force_redraw_view(View* view) {
+	if (!view) return;
+
+	mark_needs_redraw(view);
+	for (int i = 0; i < view->subviews->size; i++) {
+		force_redraw_view((View*)array_m_lookup(view->subviews, i));
+	}
+}
+
+//discard window's retained layers, re-rendering every view in it
+static void force_redraw(Window* window) {
+	mark_needs_redraw((View*)window);
+	force_redraw_view(window->title_view);
+	force_redraw_view(window->content_view);
+}
+
 void xserv_quit(Screen* screen) {
+	set_damage_handler(NULL);
+	damage_screen = NULL;
 	switch_to_text();
 	gfx_teardown(screen);
 	resign_first_responder();
 	_kill();
 }
 
-static Label* fps;
 void xserv_refresh(Screen* screen) {
 	//if (!screen->finished_drawing) return;
 
@@ -443,12 +809,17 @@ void xserv_refresh(Screen* screen) {
 			}
 			else if (ch == 'r') {
 				//force everything to refresh
-				screen->window->needs_redraw = 1;
+				force_redraw(screen->window);
 				for (int i = 0; i < screen->window->subviews->size; i++) {
 					Window* w = array_m_lookup(screen->window->subviews, i);
-					w->needs_redraw = 1;
+					force_redraw(w);
 				}
 			}
+			else if (ch == 'o') {
+				//toggle occlusion culling, to compare overdraw with it off
+				occlusion_culling = !occlusion_culling;
+				damage_add(&screen->damage, screen->damage.bounds);
+			}
 			else if (ch == 'a') {
 				//toggle alpha of topmost window between 0.5 and 1.0
 				Window* topmost = array_m_lookup(screen->window->subviews, screen->window->subviews->size - 1);
@@ -461,29 +832,24 @@ void xserv_refresh(Screen* screen) {
 		}
 	}
 
-	double time_start = time();
-	xserv_draw(screen);
-	double frame_time = (time() - time_start) / 1000.0;
-	double fps_conv = 1 / frame_time;
-
-	//draw rect to indicate whether the screen was dirtied this frame
-	//red indicates dirtied, green indicates clean
-	Rect dirtied_indicator = rect_make(point_make(0, screen->window->size.height - 25), size_make(25, 25));
-	draw_rect(screen->window->layer, dirtied_indicator, (dirtied ? color_red() : color_green()), THICKNESS_FILLED);
-
-	//update frame time tracker
-	char buf[32];
-	itoa(fps_conv, (char*)&buf);
-	strcat(buf, " FPS");
-	//itoa(frame_time * 1000, &buf);
-	//strcat(buf, " ms/frame");
-	fps->text = buf;
-	draw_label(screen->window->layer, fps);
-
 	//handle mouse events
+	//any damage they cause is composited this frame
 	process_mouse_events(screen);
 
-	write_screen(screen);
+	//only render when something changed
+	Coordinate mouse = mouse_point();
+	bool moved = !cursor.visible || mouse.x != cursor.origin.x || mouse.y != cursor.origin.y;
+	bool content_changed = screen->damage.count > 0;
+	if (!content_changed && !moved && !frame_stats_pending) return;
+
+	uint32_t frame_start = time();
+	xserv_draw(screen);
+	present_frame(screen);
+
+	//frames which only repaint the stats aren't measured, or showing a measurement would cause another one
+	if (content_changed || moved) {
+		record_frame_time(time() - frame_start);
+	}
 
 	dirtied = 0;
 }
@@ -492,8 +858,20 @@ void xserv_pause() {
 	switch_to_text();
 }
 
+//VESA mode xserv runs in, 1024x768 at the deepest supported depth
+static uint32_t xserv_mode = 0x118;
+
 void xserv_resume() {
-	switch_to_vesa(0x118, false);
+	switch_to_vesa(xserv_mode, false);
+
+	//text mode clobbered the framebuffer, push everything again
+	if (damage_screen) {
+		//setting the mode put the display start back at the first page
+		vesa_setup_page_flip(damage_screen, xserv_mode);
+		page_flip_reset(damage_screen);
+		damage_add(&damage_screen->damage, damage_screen->damage.bounds);
+		cursor.visible = false;
+	}
 }
 
 void xserv_temp_stop(uint32_t pause_length) {
@@ -504,20 +882,37 @@ void xserv_temp_stop(uint32_t pause_length) {
 
 void xserv_init_late() {
 	//switch to VESA for x serv
-	Screen* screen = switch_to_vesa(0x118, true);
+	xserv_mode = vesa_pick_mode(size_make(1024, 768), 0x118);
+	Screen* screen = switch_to_vesa(xserv_mode, true);
+	damage_screen = screen;
+	page_flip_reset(screen);
+	set_damage_handler(xserv_damage);
 	desktop_setup(screen);
+	cursor_setup();
 
-	//add FPS tracker
+	//add frame time tracker
 	//don't call add_sublabel on fps because it's drawn manually
 	//(drawn manually so we can update text with accurate frame draw time)
-	fps = create_label(rect_make(point_make(3, 3), size_make(60, 20)), "FPS counter");
+	fps = create_label(rect_make(point_make(3, 3), size_make(448, 20)), "frame stats");
 	fps->text_color = color_black();
 
 	test_xserv(screen);
 
+	//frame scheduler
+	//input is picked up once per frame interval, and the task sleeps in between instead of spinning
+	uint32_t next_frame = time();
 	while (1) {
 		xserv_refresh(screen);
-		mouse_event_wait();
+
+		next_frame += FRAME_INTERVAL;
+		int32_t remaining = next_frame - time();
+		if (remaining > 0) {
+			sleep(remaining);
+		}
+		else {
+			//fell behind, start pacing again from now rather than rendering a burst of late frames
+			next_frame = time();
+		}
 	}
 
 	_kill();